@@ -10,16 +10,36 @@ RC_ICONS = logo.ico
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
+    confcli.cpp \
+    confdiff.cpp \
+    confdiffdialog.cpp \
+    confmerge.cpp \
     confparser.cpp \
+    confpatch.cpp \
+    confstorage.cpp \
     translationstore.cpp \
+    translationtable.cpp \
+    translationpack.cpp \
     configmodel.cpp \
+    configsearchindex.cpp \
+    configfuzzymatch.cpp \
     editentrydialog.cpp
 
 HEADERS += \
     mainwindow.h \
+    confcli.h \
+    confdiff.h \
+    confdiffdialog.h \
+    confmerge.h \
     confparser.h \
+    confpatch.h \
+    confstorage.h \
     translationstore.h \
+    translationtable.h \
+    translationpack.h \
     configmodel.h \
+    configsearchindex.h \
+    configfuzzymatch.h \
     editentrydialog.h
 
 RESOURCES += resources.qrc
@@ -0,0 +1,34 @@
+# Micro benchmarks for the hot paths of ConfEdit; not part of the application.
+# Build with an optimizing (release) configuration:
+#   qmake bench/ConfEditBench.pro CONFIG+=release && make
+QT = core concurrent sql
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = ConfEditBench
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    bench.cpp \
+    legacyyaml.cpp \
+    ../configfuzzymatch.cpp \
+    ../configmodel.cpp \
+    ../configsearchindex.cpp \
+    ../confparser.cpp \
+    ../confstorage.cpp \
+    ../translationstore.cpp \
+    ../translationtable.cpp \
+    ../translationpack.cpp
+
+HEADERS += \
+    legacyyaml.h \
+    ../configfuzzymatch.h \
+    ../configmodel.h \
+    ../configsearchindex.h \
+    ../confparser.h \
+    ../confstorage.h \
+    ../translationstore.h \
+    ../translationtable.h \
+    ../translationpack.h
@@ -0,0 +1,415 @@
+#include "configmodel.h"
+#include "confparser.h"
+#include "legacyyaml.h"
+#include "translationstore.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include <limits>
+
+// Usage: ConfEditBench <benchmark> [arguments]
+// Every benchmark reports the best of several rounds, so a single slow round
+// (page faults, another process) does not skew the result.
+
+namespace {
+
+const int kRounds = 10;
+
+template <typename Function>
+qint64 bestOf(int rounds, Function function)
+{
+    qint64 best = std::numeric_limits<qint64>::max();
+    for (int i = 0; i < rounds; ++i)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        best = qMin(best, timer.nsecsElapsed());
+    }
+    return best;
+}
+
+QString formatMs(qint64 nsecs)
+{
+    return QString::number(nsecs / 1e6, 'f', 3) + QStringLiteral(" ms");
+}
+
+bool readFiles(const QStringList &paths, QByteArray *data, QTextStream &err)
+{
+    for (const QString &path : paths)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            err << QString("无法打开文件：%1").arg(path) << "\n";
+            return false;
+        }
+        data->append(file.readAll());
+    }
+    return true;
+}
+
+// Index of the first line or entry where the two parses differ, -1 when the
+// lines and entries are identical
+int firstDifference(const ConfParser &a, const ConfParser &b)
+{
+    const QVector<ConfLine> &linesA = a.lines();
+    const QVector<ConfLine> &linesB = b.lines();
+    for (int i = 0; i < qMin(linesA.size(), linesB.size()); ++i)
+    {
+        const ConfLine &x = linesA[i];
+        const ConfLine &y = linesB[i];
+        if (x.offset != y.offset || x.length != y.length || x.valueBegin != y.valueBegin ||
+            x.valueLength != y.valueLength || x.sectionId != y.sectionId || x.type != y.type ||
+            x.eolLength != y.eolLength || x.hasNewValue != y.hasNewValue)
+        {
+            return i;
+        }
+    }
+    if (linesA.size() != linesB.size())
+        return qMin(linesA.size(), linesB.size());
+
+    const QVector<ConfigEntry> &entriesA = a.entries();
+    const QVector<ConfigEntry> &entriesB = b.entries();
+    for (int i = 0; i < qMin(entriesA.size(), entriesB.size()); ++i)
+    {
+        const ConfigEntry &x = entriesA[i];
+        const ConfigEntry &y = entriesB[i];
+        if (x.key != y.key || x.section != y.section || x.value != y.value || x.lineIndex != y.lineIndex)
+            return i;
+    }
+    return entriesA.size() != entriesB.size() ? qMin(entriesA.size(), entriesB.size()) : -1;
+}
+
+// ConfParser::load on one thread and in parallel chunks, over the given files
+// repeated up to 16 MB. Both have to give exactly the same lines and entries.
+int benchParse(const QStringList &args, QTextStream &out, QTextStream &err)
+{
+    QByteArray source;
+    if (args.isEmpty() || !readFiles(args, &source, err) || source.isEmpty())
+        return 2;
+    if (!source.endsWith('\n'))
+        source.append('\n');
+
+    QTemporaryFile file;
+    if (!file.open())
+    {
+        err << "无法创建临时文件" << "\n";
+        return 2;
+    }
+    while (file.size() < 16 * 1024 * 1024)
+        file.write(source);
+    file.close();
+    const QString path = file.fileName();
+
+    ConfParser serial;
+    serial.setParseMode(ConfParser::SerialParse);
+    ConfParser parallel;
+    parallel.setParseMode(ConfParser::ParallelParse);
+    QString error;
+    if (!serial.load(path, &error) || !parallel.load(path, &error))
+    {
+        err << error << "\n";
+        return 2;
+    }
+    const int difference = firstDifference(serial, parallel);
+
+    auto run = [&](ConfParser::ParseMode mode) {
+        return bestOf(kRounds, [&]() {
+            ConfParser parser;
+            parser.setParseMode(mode);
+            parser.load(path, nullptr);
+        });
+    };
+    const qint64 serialTime = run(ConfParser::SerialParse);
+    const qint64 parallelTime = run(ConfParser::ParallelParse);
+
+    const double megabytes = QFileInfo(path).size() / (1024.0 * 1024.0);
+    out << QString("解析 %1 MB，%2 行，%3 个配置项").arg(megabytes, 0, 'f', 1)
+               .arg(serial.lines().size()).arg(serial.entries().size()) << "\n";
+    out << QString("  单线程：%1").arg(formatMs(serialTime)) << "\n";
+    out << QString("  并行：%1").arg(formatMs(parallelTime)) << "\n";
+    if (difference >= 0)
+    {
+        err << QString("单线程与并行解析的结果不同，第 %1 项起").arg(difference) << "\n";
+        return 1;
+    }
+    out << "  两种解析结果一致" << "\n";
+    return 0;
+}
+
+// First difference between the items TranslationStore loaded and the ones the
+// line-by-line loader read, empty when both hold the same versions and items
+QString firstYamlDifference(TranslationStore *store, const LegacyTranslations &versions,
+                            const QStringList &order)
+{
+    if (store->availableVersions() != order)
+        return QString("版本列表不同：%1 / %2").arg(store->availableVersions().join(","), order.join(","));
+    for (const QString &version : order)
+    {
+        store->setCurrentVersion(version);
+        const QHash<QString, TranslationItem> &legacy = versions[version];
+        const QVector<TranslationItem> items = store->allItems();
+        if (items.size() != legacy.size())
+            return QString("版本 %1 的条目数不同：%2 / %3").arg(version).arg(items.size()).arg(legacy.size());
+        for (const TranslationItem &item : items)
+        {
+            const auto it = legacy.constFind(item.key);
+            if (it == legacy.constEnd() || it->section != item.section || it->nameZh != item.nameZh ||
+                it->descriptionZh != item.descriptionZh)
+            {
+                return QString("版本 %1 的 %2 不同").arg(version, item.key);
+            }
+        }
+    }
+    return QString();
+}
+
+// TranslationStore's single-pass YAML loader against the line-by-line loader
+// it replaced. Both have to read the same versions and items.
+int benchYaml(const QStringList &args, QTextStream &out, QTextStream &err)
+{
+    if (args.size() != 1)
+        return 2;
+    const QString path = args.first();
+
+    TranslationStore store;
+    QString error;
+    if (!store.load(path, &error))
+    {
+        err << error << "\n";
+        return 2;
+    }
+    LegacyTranslations versions;
+    QStringList order;
+    if (!legacyLoadYaml(path, &versions, &order))
+    {
+        err << QString("无法打开文件：%1").arg(path) << "\n";
+        return 2;
+    }
+    int items = 0;
+    for (const auto &version : qAsConst(versions))
+        items += version.size();
+    const QString difference = firstYamlDifference(&store, versions, order);
+
+    const qint64 current = bestOf(kRounds, [&]() {
+        TranslationStore loaded;
+        loaded.load(path, nullptr);
+    });
+    const qint64 legacy = bestOf(kRounds, [&]() {
+        LegacyTranslations legacyVersions;
+        QStringList legacyOrder;
+        legacyLoadYaml(path, &legacyVersions, &legacyOrder);
+    });
+
+    out << QString("加载 %1（%2 个版本，%3 项）").arg(path).arg(order.size()).arg(items) << "\n";
+    out << QString("  单遍加载：%1").arg(formatMs(current)) << "\n";
+    out << QString("  原逐行加载：%1").arg(formatMs(legacy)) << "\n";
+    if (!difference.isEmpty())
+    {
+        err << QString("两种加载结果不同：%1").arg(difference) << "\n";
+        return 1;
+    }
+    out << "  两种加载结果一致" << "\n";
+    return 0;
+}
+
+// Opening a translation file and merging it into a config the way
+// MainWindow::mergeTranslations does: one lookup per entry, strings shared
+int benchMerge(const QStringList &args, QTextStream &out, QTextStream &err)
+{
+    if (args.size() != 2)
+        return 2;
+
+    ConfParser parser;
+    QString error;
+    if (!parser.load(args[0], &error))
+    {
+        err << error << "\n";
+        return 2;
+    }
+    TranslationStore translations;
+    if (!translations.load(args[1], &error))
+    {
+        err << error << "\n";
+        return 2;
+    }
+
+    const qint64 load = bestOf(kRounds, [&]() {
+        TranslationStore loaded;
+        loaded.load(args[1], nullptr);
+    });
+
+    int found = 0;
+    const qint64 merge = bestOf(kRounds, [&]() {
+        found = 0;
+        for (ConfigEntry &entry : parser.entries())
+        {
+            entry.section.clear();
+            if (const TranslationItem *item = translations.find(entry.key))
+            {
+                entry.section = parser.internText(item->section);
+                entry.nameZh = item->nameZh;
+                entry.descriptionZh = item->descriptionZh;
+                ++found;
+            }
+        }
+    });
+
+    out << QString("%1 个配置项，%2 个有翻译").arg(parser.entries().size()).arg(found) << "\n";
+    out << QString("  加载翻译：%1").arg(formatMs(load)) << "\n";
+    out << QString("  合并：%1").arg(formatMs(merge)) << "\n";
+    return 0;
+}
+
+// Entries shaped like worldserver.conf with translations: dotted camel case
+// keys, short Chinese names and descriptions of a hundred characters or so.
+// The same count always gives the same entries.
+QVector<ConfigEntry> syntheticEntries(int count)
+{
+    static const char *const kWords[] = {
+        "Max", "Min", "Player", "Level", "Rate", "Drop", "Xp", "Honor", "Arena", "Bot",
+        "Map", "Update", "Threads", "Interval", "Quest", "Guild", "Chat", "Log", "Db", "Port",
+    };
+    static const QString kHan = QStringLiteral(
+        "最大最小玩家等级倍率掉落经验荣誉竞技场机器人地图更新线程间隔任务公会聊天日志数据库端口"
+        "服务器世界启用禁用数量时间秒分钟设置默认允许开关值每个上限下限");
+    const int wordCount = int(sizeof(kWords) / sizeof(kWords[0]));
+
+    quint32 seed = 12345;
+    auto next = [&seed](int bound) {
+        seed = seed * 1103515245u + 12345u;
+        return int((seed >> 8) % quint32(bound));
+    };
+    auto han = [&](int length) {
+        QString text;
+        text.reserve(length);
+        for (int i = 0; i < length; ++i)
+            text += kHan[next(kHan.size())];
+        return text;
+    };
+
+    QVector<ConfigEntry> entries(count);
+    for (int i = 0; i < count; ++i)
+    {
+        ConfigEntry &entry = entries[i];
+        entry.key = QString::fromLatin1(kWords[next(wordCount)]) + QLatin1Char('.');
+        for (int w = 1 + next(3); w > 0; --w)
+            entry.key += QString::fromLatin1(kWords[next(wordCount)]);
+        entry.key += QString::number(i);
+        entry.nameZh = han(4 + next(6));
+        entry.descriptionZh = han(60 + next(80));
+        entry.value = QString::number(next(1000));
+        entry.lineIndex = i;
+    }
+    return entries;
+}
+
+// Search box latency: every prefix of a query is matched against all rows,
+// as typing it one character at a time does. The folded keys ConfigModel
+// keeps are compared with building and lowering each row's text per
+// keystroke, as the filter did before, and with verifying only the rows the
+// n-gram index leaves (prefixes too short for grams scan every row).
+int benchFilter(const QStringList &args, QTextStream &out, QTextStream &)
+{
+    if (!args.isEmpty())
+        return 2;
+
+    const QStringList queries = { QStringLiteral("maxplayer"), QStringLiteral("玩家等级") };
+    const QAtomicInt latest(0);
+    for (int count : { 2000, 100000 })
+    {
+        QVector<ConfigEntry> entries = syntheticEntries(count);
+        ConfigModel model;
+        model.setEntries(&entries);
+        // Taken before the n-gram index is back, so every row is scanned
+        const ConfigSearchSnapshot snapshot = model.searchSnapshot();
+
+        ConfigSearchSnapshot indexed = snapshot;
+        const qint64 build = bestOf(3, [&]() {
+            ConfigSearchIndex index;
+            index.build(indexed.keys);
+            indexed.index = std::move(index);
+        });
+        indexed.indexReady = true;
+
+        out << QString("%1 行，建立索引 %2").arg(count).arg(formatMs(build)) << "\n";
+        for (const QString &query : queries)
+        {
+            qint64 folded = 0;
+            qint64 index = 0;
+            qint64 indexLast = 0;
+            qint64 legacy = 0;
+            int matches = 0;
+            for (int length = 1; length <= query.size(); ++length)
+            {
+                const QString typed = query.left(length);
+                const QString foldedText = typed.toCaseFolded();
+                folded += bestOf(kRounds, [&]() {
+                    snapshot.match(foldedText, QVector<quint64>(), &latest, 0);
+                });
+                indexLast = bestOf(kRounds, [&]() {
+                    indexed.match(foldedText, QVector<quint64>(), &latest, 0);
+                });
+                index += indexLast;
+                // Slow enough at 100k rows that fewer rounds do
+                legacy += bestOf(3, [&]() {
+                    matches = 0;
+                    for (const ConfigEntry &entry : qAsConst(entries))
+                    {
+                        const QString text = QString("%1 %2 %3").arg(entry.key, entry.nameZh, entry.descriptionZh).toLower();
+                        if (text.contains(typed.toLower()))
+                            ++matches;
+                    }
+                });
+            }
+            out << QString("  「%1」（最终 %2 行匹配），每次按键平均：").arg(query).arg(matches) << "\n";
+            out << QString("    n-gram 索引：%1（完整查询 %2）").arg(formatMs(index / query.size()), formatMs(indexLast)) << "\n";
+            out << QString("    预先折叠：%1").arg(formatMs(folded / query.size())) << "\n";
+            out << QString("    逐行拼接：%1").arg(formatMs(legacy / query.size())) << "\n";
+        }
+    }
+    return 0;
+}
+
+struct Benchmark
+{
+    const char *name;
+    const char *arguments;
+    int (*run)(const QStringList &args, QTextStream &out, QTextStream &err);
+};
+
+const Benchmark kBenchmarks[] = {
+    { "parse", "<配置文件>...", benchParse },
+    { "yaml", "<translation.yaml>", benchYaml },
+    { "merge", "<配置文件> <翻译文件>", benchMerge },
+    { "filter", "", benchFilter },
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList args = app.arguments().mid(1);
+    const QString name = args.isEmpty() ? QString() : args.takeFirst();
+    for (const Benchmark &benchmark : kBenchmarks)
+    {
+        if (name == QLatin1String(benchmark.name))
+            return benchmark.run(args, out, err);
+    }
+
+    err << "用法：ConfEditBench <测试> [参数]" << "\n";
+    for (const Benchmark &benchmark : kBenchmarks)
+        err << "  " << benchmark.name << " " << QString::fromUtf8(benchmark.arguments) << "\n";
+    return 2;
+}
@@ -0,0 +1,230 @@
+#include "legacyyaml.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+// The YAML loader as it was before the single-pass rewrite (QTextStream,
+// one QString per line, seek back after looking ahead), kept as it was apart
+// from writing into plain containers instead of TranslationStore members
+
+static QString stripQuotes(const QString &value)
+{
+    if (value.size() >= 2)
+    {
+        if ((value.startsWith('"') && value.endsWith('"')) ||
+            (value.startsWith('\'') && value.endsWith('\'')))
+        {
+            return value.mid(1, value.size() - 2);
+        }
+    }
+    return value;
+}
+
+static bool parseKeyValue(const QString &line, QString *keyOut, QString *valueOut)
+{
+    int colon = line.indexOf(':');
+    if (colon < 0)
+        return false;
+
+    QString key = line.left(colon).trimmed();
+    QString value = line.mid(colon + 1).trimmed();
+    if (key.isEmpty())
+        return false;
+
+    if (keyOut)
+        *keyOut = key;
+    if (valueOut)
+        *valueOut = stripQuotes(value);
+    return true;
+}
+
+bool legacyLoadYaml(const QString &path, LegacyTranslations *versions, QStringList *versionOrder)
+{
+    versions->clear();
+    versionOrder->clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+    TranslationItem current;
+    bool inItem = false;
+    bool inMultilineDesc = false;
+    int multilineIndent = 0;
+    QStringList multilineLines;
+    bool inVersions = false;
+    bool inItems = false;
+    bool inLegacyList = false;
+    QString currentVersion;
+
+    while (!in.atEnd())
+    {
+        QString line = in.readLine();
+        QString trimmed = line.trimmed();
+        int leadingSpaces = 0;
+        while (leadingSpaces < line.size() && line[leadingSpaces] == ' ')
+            leadingSpaces++;
+
+        // Handle multiline description continuation
+        if (inMultilineDesc)
+        {
+            // Check if this line is still part of the multiline block
+            int indent = leadingSpaces;
+
+            // If line is empty or has sufficient indentation, it's part of the block
+            if (trimmed.isEmpty() || indent >= multilineIndent)
+            {
+                multilineLines.append(trimmed);
+                continue;
+            }
+            else
+            {
+                // End of multiline block
+                current.descriptionZh = multilineLines.join("\n");
+                inMultilineDesc = false;
+                multilineLines.clear();
+            }
+        }
+
+        if (trimmed.isEmpty() || trimmed.startsWith('#'))
+            continue;
+
+        if (trimmed == "versions:")
+        {
+            inVersions = true;
+            inItems = false;
+            inLegacyList = false;
+            continue;
+        }
+
+        if (inVersions)
+        {
+            // Version keys are only valid at indent level 2: "  'version':"
+            if (leadingSpaces == 2 && trimmed.endsWith(':') && trimmed != "items:")
+            {
+                if (inItem && !current.key.isEmpty() && !currentVersion.isEmpty())
+                {
+                    (*versions)[currentVersion].insert(current.key, current);
+                    current = TranslationItem();
+                    inItem = false;
+                }
+                // Validate that the next meaningful line is "items:" at indent 4
+                qint64 lastPos = in.pos();
+                QString nextLine;
+                while (!in.atEnd())
+                {
+                    nextLine = in.readLine();
+                    QString nextTrimmed = nextLine.trimmed();
+                    if (nextTrimmed.isEmpty() || nextTrimmed.startsWith('#'))
+                        continue;
+                    int nextLeading = 0;
+                    while (nextLeading < nextLine.size() && nextLine[nextLeading] == ' ')
+                        nextLeading++;
+                    bool validItems = (nextLeading == 4 && nextTrimmed == "items:");
+                    in.seek(lastPos);
+                    if (!validItems)
+                        nextLine.clear();
+                    break;
+                }
+                if (!nextLine.isEmpty())
+                {
+                    currentVersion = stripQuotes(trimmed.left(trimmed.size() - 1).trimmed());
+                    if (!currentVersion.isEmpty() && !versions->contains(currentVersion))
+                    {
+                        versions->insert(currentVersion, QHash<QString, TranslationItem>());
+                        versionOrder->append(currentVersion);
+                    }
+                    inItems = false;
+                    continue;
+                }
+            }
+            // "items:" is only valid under a version at indent level 4
+            if (leadingSpaces == 4 && trimmed == "items:")
+            {
+                inItems = true;
+                continue;
+            }
+        }
+
+        if (trimmed.startsWith('-'))
+        {
+            if (!inVersions)
+            {
+                if (!inLegacyList)
+                {
+                    currentVersion = "default";
+                    versions->insert(currentVersion, QHash<QString, TranslationItem>());
+                    versionOrder->append(currentVersion);
+                    inLegacyList = true;
+                }
+                inItems = true;
+            }
+            else if (!inItems)
+            {
+                continue;
+            }
+
+            if (inItem && !current.key.isEmpty())
+                (*versions)[currentVersion].insert(current.key, current);
+
+            current = TranslationItem();
+            inItem = true;
+
+            QString rest = trimmed.mid(1).trimmed();
+            if (!rest.isEmpty())
+            {
+                QString key;
+                QString value;
+                if (parseKeyValue(rest, &key, &value))
+                {
+                    if (key == "key")
+                        current.key = value;
+                }
+            }
+            continue;
+        }
+
+        if (!inItem)
+            continue;
+
+        QString key;
+        QString value;
+        if (!parseKeyValue(trimmed, &key, &value))
+            continue;
+
+        if (key == "key")
+            current.key = value;
+        else if (key == "section")
+            current.section = value;
+        else if (key == "name_zh")
+            current.nameZh = value;
+        else if (key == "description_zh")
+        {
+            if (value == "|" || value == ">")
+            {
+                // Start multiline block
+                inMultilineDesc = true;
+                multilineIndent = leadingSpaces + 2; // YAML block indent is parent indent + 2
+                multilineLines.clear();
+            }
+            else
+            {
+                current.descriptionZh = value;
+            }
+        }
+    }
+
+    // Handle end of file with multiline description
+    if (inMultilineDesc && !multilineLines.isEmpty())
+    {
+        current.descriptionZh = multilineLines.join("\n");
+    }
+
+    if (inItem && !current.key.isEmpty())
+        (*versions)[currentVersion].insert(current.key, current);
+
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+
+#include "translationtable.h"
+
+class QStringList;
+
+// Version -> key -> item, the layout TranslationStore used before its flat lookup table
+using LegacyTranslations = QHash<QString, QHash<QString, TranslationItem>>;
+
+// The line-by-line loader replaced by TranslationStore::parseYaml; only kept
+// as the baseline of the "yaml" benchmark
+bool legacyLoadYaml(const QString &path, LegacyTranslations *versions, QStringList *versionOrder);
@@ -0,0 +1,419 @@
+#include "confcli.h"
+#include "confdiff.h"
+#include "confmerge.h"
+#include "confparser.h"
+#include "confpatch.h"
+#include "confstorage.h"
+#include "translationstore.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocale>
+#include <QTextStream>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+namespace {
+
+enum ExitCode
+{
+    ExitOk = 0,
+    ExitMismatch = 1,   // Key not found, or the configs differ
+    ExitError = 2
+};
+
+const char *const kCommands[] = { "--get", "--set", "--apply", "--diff", "--upgrade", "--describe",
+                                  "--convert-translations", "--search" };
+
+const int kSearchLimit = 50;
+
+#if defined(Q_OS_WIN)
+// The GUI build has no console of its own; write to the one we were started
+// from unless the output is already redirected to a file or pipe
+void attachParentConsole()
+{
+    const HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (output && output != INVALID_HANDLE_VALUE && GetFileType(output) != FILE_TYPE_UNKNOWN)
+        return;
+    if (AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+}
+#endif
+
+bool loadConfig(ConfParser *parser, const QString &path, QTextStream &err)
+{
+    QString error;
+    if (parser->load(path, &error))
+        return true;
+    err << error << "\n";
+    return false;
+}
+
+int runGet(const QString &key, const QString &path, QTextStream &out, QTextStream &err)
+{
+    ConfParser parser;
+    if (!loadConfig(&parser, path, err))
+        return ExitError;
+
+    const ConfigEntry *entry = parser.findEntry(key);
+    if (!entry)
+    {
+        err << QString("未找到配置键：%1").arg(key) << "\n";
+        return ExitMismatch;
+    }
+    out << entry->value << "\n";
+    return ExitOk;
+}
+
+int runSet(const QStringList &assignments, const QString &path, QTextStream &out, QTextStream &err)
+{
+    ConfParser parser;
+    if (!loadConfig(&parser, path, err))
+        return ExitError;
+
+    // Every assignment is checked before anything is written
+    QVector<QPair<int, QString>> changes;
+    for (const QString &assignment : assignments)
+    {
+        const int eq = assignment.indexOf('=');
+        const QString key = assignment.left(eq).trimmed();
+        if (eq <= 0 || key.isEmpty())
+        {
+            err << QString("无效的赋值：%1（应为 键=值）").arg(assignment) << "\n";
+            return ExitError;
+        }
+        const int index = parser.entryIndex(key);
+        if (index < 0)
+        {
+            err << QString("未找到配置键：%1").arg(key) << "\n";
+            return ExitMismatch;
+        }
+        changes.push_back(qMakePair(index, assignment.mid(eq + 1).trimmed()));
+    }
+
+    for (const auto &change : changes)
+    {
+        const ConfigEntry &entry = parser.entries()[change.first];
+        if (entry.value != change.second)
+            out << QString("%1: %2 -> %3").arg(entry.key, entry.value, change.second) << "\n";
+        parser.setEntryValue(change.first, change.second);
+    }
+
+    QString error;
+    if (!parser.save(path, &error))
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+    return ExitOk;
+}
+
+int runApply(const QString &patchPath, const QString &path, QTextStream &out, QTextStream &err)
+{
+    ConfPatch patch;
+    QString error;
+    if (!patch.load(patchPath, &error))
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+
+    ConfParser parser;
+    if (!loadConfig(&parser, path, err))
+        return ExitError;
+
+    const ConfPatchResult result = patch.apply(&parser);
+    if (!result.changedEntries.isEmpty() && !parser.save(path, &error))
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+
+    out << QString("已修改 %1 个，未变化 %2 个，未找到 %3 个配置键")
+               .arg(result.changedEntries.size())
+               .arg(result.unchangedKeys.size())
+               .arg(result.unknownKeys.size()) << "\n";
+    for (const QString &key : result.unknownKeys)
+        err << QString("未找到配置键：%1").arg(key) << "\n";
+    return result.unknownKeys.isEmpty() ? ExitOk : ExitMismatch;
+}
+
+int runDiff(const QString &leftPath, const QString &rightPath, QTextStream &out, QTextStream &err)
+{
+    ConfParser left;
+    ConfParser right;
+    if (!loadConfig(&left, leftPath, err) || !loadConfig(&right, rightPath, err))
+        return ExitError;
+
+    ConfDiff diff;
+    diff.compare(left, right);
+    for (const ConfDiffItem &item : diff.items())
+    {
+        const ConfigEntry *leftEntry = item.leftEntry >= 0 ? &left.entries()[item.leftEntry] : nullptr;
+        const ConfigEntry *rightEntry = item.rightEntry >= 0 ? &right.entries()[item.rightEntry] : nullptr;
+        switch (item.kind)
+        {
+        case ConfDiffItem::Removed:
+            out << QString("- %1 = %2").arg(leftEntry->key, leftEntry->value) << "\n";
+            break;
+        case ConfDiffItem::Added:
+            out << QString("+ %1 = %2").arg(rightEntry->key, rightEntry->value) << "\n";
+            break;
+        case ConfDiffItem::Changed:
+            out << QString("~ %1: %2 -> %3").arg(leftEntry->key, leftEntry->value, rightEntry->value) << "\n";
+            break;
+        case ConfDiffItem::Unchanged:
+            break;
+        }
+    }
+    return diff.isEmpty() ? ExitOk : ExitMismatch;
+}
+
+int runUpgrade(const QString &basePath, const QString &theirsPath, const QString &oursPath,
+               const QString &outputPath, QTextStream &out, QTextStream &err)
+{
+    ConfParser base;
+    ConfParser theirs;
+    ConfParser ours;
+    if (!loadConfig(&base, basePath, err) || !loadConfig(&theirs, theirsPath, err) ||
+        !loadConfig(&ours, oursPath, err))
+    {
+        return ExitError;
+    }
+
+    const ConfMergeResult result = ConfMerge::merge(base, ours, theirs);
+    QString error;
+    if (!writeFileAtomically(outputPath, result.data, &error))
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+
+    out << QString("已写入 %1：保留 %2 个自定义值，%3 个冲突，%4 个已移除的键，%5 个额外的键")
+               .arg(outputPath)
+               .arg(result.carriedValues)
+               .arg(result.conflicts.size())
+               .arg(result.droppedKeys.size())
+               .arg(result.customKeys.size()) << "\n";
+    for (const ConfMergeConflict &conflict : result.conflicts)
+    {
+        out << QString("! %1（第 %2 行）：旧模板 %3，新模板 %4，保留当前值 %5")
+                   .arg(conflict.key)
+                   .arg(conflict.lineNumber)
+                   .arg(conflict.baseValue, conflict.theirsValue, conflict.oursValue) << "\n";
+    }
+    for (const QString &key : result.droppedKeys)
+        out << QString("- %1（新模板已移除，自定义值未保留）").arg(key) << "\n";
+    for (const QString &key : result.customKeys)
+        out << QString("+ %1（不在模板中，已追加到文件末尾）").arg(key) << "\n";
+    return result.conflicts.isEmpty() ? ExitOk : ExitMismatch;
+}
+
+int runDescribe(const QString &key, const QString &path, const QString &translationPath,
+                const QString &version, QTextStream &out, QTextStream &err)
+{
+    ConfParser parser;
+    if (!loadConfig(&parser, path, err))
+        return ExitError;
+
+    const ConfigEntry *entry = parser.findEntry(key);
+    if (!entry)
+    {
+        err << QString("未找到配置键：%1").arg(key) << "\n";
+        return ExitMismatch;
+    }
+
+    out << QString("键：%1").arg(entry->key) << "\n";
+    out << QString("值：%1").arg(entry->value) << "\n";
+    out << QString("行号：%1").arg(entry->lineIndex + 1) << "\n";
+
+    // Missing translations are not an error; the config part is still useful.
+    // Loading read-only keeps a describe from creating or migrating the database
+    if (!QFileInfo::exists(translationPath))
+    {
+        err << QString("未找到翻译文件：%1").arg(translationPath) << "\n";
+        return ExitOk;
+    }
+    TranslationStore translations;
+    QString error;
+    if (!translations.load(translationPath, &error, version, TranslationStore::ReadOnly))
+    {
+        err << error << "\n";
+        return ExitOk;
+    }
+    if (!version.isEmpty() && translations.currentVersion() != version)
+        err << QString("未找到翻译版本：%1").arg(version) << "\n";
+
+    if (const TranslationItem *item = translations.find(entry->key))
+    {
+        out << QString("分类：%1").arg(item->section) << "\n";
+        out << QString("名称：%1").arg(item->nameZh) << "\n";
+        out << QString("说明：%1").arg(item->descriptionZh) << "\n";
+    }
+    return ExitOk;
+}
+
+int runSearch(const QString &query, const QString &translationPath, const QString &version,
+              QTextStream &out, QTextStream &err)
+{
+    // Read-only, so searching never creates or migrates the database
+    if (!QFileInfo::exists(translationPath))
+    {
+        err << QString("未找到翻译文件：%1").arg(translationPath) << "\n";
+        return ExitError;
+    }
+    TranslationStore translations;
+    QString error;
+    if (!translations.load(translationPath, &error, QString(), TranslationStore::ReadOnly))
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+
+    const QVector<TranslationSearchHit> hits = translations.search(query, version, kSearchLimit, &error);
+    if (!error.isEmpty())
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+    if (hits.isEmpty())
+    {
+        err << QString("没有匹配的配置键：%1").arg(query) << "\n";
+        return ExitMismatch;
+    }
+
+    for (const TranslationSearchHit &hit : hits)
+        out << hit.version << '\t' << hit.key << '\t' << hit.nameZh << "\n";
+    return ExitOk;
+}
+
+int runConvertTranslations(const QString &sourcePath, const QString &targetPath, QTextStream &out, QTextStream &err)
+{
+    TranslationStore translations;
+    QString error;
+    if (!translations.load(sourcePath, &error) || !translations.save(targetPath, &error))
+    {
+        err << error << "\n";
+        return ExitError;
+    }
+    out << QString("已转换 %1 个翻译版本：%2").arg(translations.availableVersions().size()).arg(targetPath) << "\n";
+
+    const TranslationTextStats stats = translations.textStats();
+    const QLocale locale;
+    out << QString("文本去重：%1 处文本共用 %2 份，占用 %3（不去重为 %4）")
+               .arg(stats.references)
+               .arg(stats.uniqueTexts)
+               .arg(locale.formattedDataSize(stats.storedBytes))
+               .arg(locale.formattedDataSize(stats.referencedBytes))
+        << "\n";
+    return ExitOk;
+}
+
+} // namespace
+
+bool ConfCli::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        for (const char *command : kCommands)
+        {
+            const size_t length = std::strlen(command);
+            if (std::strncmp(argv[i], command, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '='))
+                return true;
+        }
+    }
+    return false;
+}
+
+int ConfCli::run(const QStringList &arguments)
+{
+#if defined(Q_OS_WIN)
+    attachParentConsole();
+#endif
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    out.setCodec("UTF-8");
+    err.setCodec("UTF-8");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("WY配置编辑器命令行模式");
+    const QCommandLineOption helpOption = parser.addHelpOption();
+    const QCommandLineOption getOption("get", "输出配置键的当前值。", "key");
+    const QCommandLineOption setOption("set", "修改配置键的值，可重复使用；所有修改一次保存。", "key=value");
+    const QCommandLineOption applyOption("apply", "批量应用补丁文件（键=值 文本或 JSON 对象），所有修改一次保存。", "patch");
+    const QCommandLineOption diffOption("diff", "比较两个配置文件中各配置键的生效值。");
+    const QCommandLineOption upgradeOption("upgrade", "三方合并升级：<旧 .dist> <新 .dist> <当前配置>，按新模板生成配置并保留自定义值。");
+    const QCommandLineOption outputOption("output", "--upgrade 的输出文件，默认为 <当前配置>.merged。", "path");
+    const QCommandLineOption describeOption("describe", "输出配置键的值与中文翻译。", "key");
+    const QCommandLineOption convertOption("convert-translations", "转换翻译文件格式：<源文件> <目标文件>，格式由扩展名决定（.db、.wypack 或 .yaml）。");
+    const QCommandLineOption searchOption("search", "在翻译数据库中按键名、中文名称和说明全文搜索，按相关度输出“版本、键、名称”。", "query");
+    const QCommandLineOption translationOption("translations", "--describe、--search 使用的翻译文件，默认为当前目录下的 translation.db。", "path");
+    const QCommandLineOption versionOption("translation-version", "--describe 使用的翻译版本；--search 只搜索该版本。", "version");
+    parser.addOptions({ getOption, setOption, applyOption, diffOption, upgradeOption, outputOption,
+                        describeOption, convertOption, searchOption, translationOption, versionOption });
+    parser.addPositionalArgument("files", "配置文件；--diff、--convert-translations 需要两个，--upgrade 需要三个，--search 不需要。", "<file> [file...]");
+
+    if (!parser.parse(arguments))
+    {
+        err << parser.errorText() << "\n";
+        return ExitError;
+    }
+    if (parser.isSet(helpOption))
+    {
+        out << parser.helpText();
+        return ExitOk;
+    }
+
+    const int commands = int(parser.isSet(getOption)) + int(parser.isSet(setOption)) +
+                         int(parser.isSet(applyOption)) + int(parser.isSet(diffOption)) +
+                         int(parser.isSet(upgradeOption)) + int(parser.isSet(describeOption)) +
+                         int(parser.isSet(convertOption)) + int(parser.isSet(searchOption));
+    const QStringList files = parser.positionalArguments();
+    int expectedFiles = 1;
+    if (parser.isSet(upgradeOption))
+        expectedFiles = 3;
+    else if (parser.isSet(diffOption) || parser.isSet(convertOption))
+        expectedFiles = 2;
+    else if (parser.isSet(searchOption))
+        expectedFiles = 0;
+    if (commands != 1 || files.size() != expectedFiles)
+    {
+        err << parser.helpText();
+        return ExitError;
+    }
+
+    if (parser.isSet(getOption))
+        return runGet(parser.value(getOption), files.first(), out, err);
+    if (parser.isSet(setOption))
+        return runSet(parser.values(setOption), files.first(), out, err);
+    if (parser.isSet(applyOption))
+        return runApply(parser.value(applyOption), files.first(), out, err);
+    if (parser.isSet(diffOption))
+        return runDiff(files[0], files[1], out, err);
+    if (parser.isSet(convertOption))
+        return runConvertTranslations(files[0], files[1], out, err);
+    if (parser.isSet(upgradeOption))
+    {
+        const QString outputPath = parser.isSet(outputOption) ? parser.value(outputOption) : files[2] + ".merged";
+        return runUpgrade(files[0], files[1], files[2], outputPath, out, err);
+    }
+
+    const QString translationPath = parser.isSet(translationOption)
+        ? parser.value(translationOption)
+        : QDir::current().filePath("translation.db");
+    if (parser.isSet(searchOption))
+        return runSearch(parser.value(searchOption), translationPath, parser.value(versionOption), out, err);
+    return runDescribe(parser.value(describeOption), files.first(), translationPath,
+                       parser.value(versionOption), out, err);
+}
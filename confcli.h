@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QStringList>
+
+// Headless mode for scripts: reads and edits configs through ConfParser and
+// TranslationStore only, without creating any widgets.
+class ConfCli
+{
+public:
+    // True when the command line asks for a CLI command; checked before any
+    // application object exists so the GUI is never initialized
+    static bool isRequested(int argc, char *argv[]);
+    static int run(const QStringList &arguments);
+};
@@ -0,0 +1,55 @@
+#include "confdiff.h"
+#include "confparser.h"
+
+#include <algorithm>
+#include <iterator>
+
+void ConfDiff::compare(const ConfParser &left, const ConfParser &right)
+{
+    m_items.clear();
+    std::fill(std::begin(m_counts), std::end(m_counts), 0);
+
+    const QVector<ConfigEntry> &leftEntries = left.entries();
+    const QVector<ConfigEntry> &rightEntries = right.entries();
+    m_items.reserve(qMax(leftEntries.size(), rightEntries.size()));
+
+    // Keys defined more than once only count at their effective occurrence
+    int nextRight = 0;
+    auto flushAdded = [&](int end) {
+        for (; nextRight < end; ++nextRight)
+        {
+            const QString &key = rightEntries[nextRight].key;
+            if (right.entryIndex(key) == nextRight && left.entryIndex(key) < 0)
+                append(ConfDiffItem::Added, -1, nextRight);
+        }
+    };
+
+    for (int i = 0; i < leftEntries.size(); ++i)
+    {
+        const ConfigEntry &entry = leftEntries[i];
+        if (left.entryIndex(entry.key) != i)
+            continue;
+
+        const int j = right.entryIndex(entry.key);
+        if (j < 0)
+        {
+            append(ConfDiffItem::Removed, i, -1);
+            continue;
+        }
+
+        flushAdded(j);
+        nextRight = qMax(nextRight, j + 1);
+        append(entry.value == rightEntries[j].value ? ConfDiffItem::Unchanged : ConfDiffItem::Changed, i, j);
+    }
+    flushAdded(rightEntries.size());
+}
+
+void ConfDiff::append(ConfDiffItem::Kind kind, int leftEntry, int rightEntry)
+{
+    ConfDiffItem item;
+    item.kind = kind;
+    item.leftEntry = leftEntry;
+    item.rightEntry = rightEntry;
+    m_items.push_back(item);
+    ++m_counts[kind];
+}
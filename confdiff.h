@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QVector>
+
+class ConfParser;
+
+struct ConfDiffItem
+{
+    enum Kind : quint8
+    {
+        Unchanged,
+        Changed,
+        Added,      // Only in the right file
+        Removed     // Only in the left file
+    };
+
+    Kind kind = Unchanged;
+    int leftEntry = -1;     // Entry index in the left parser, -1 when added
+    int rightEntry = -1;    // Entry index in the right parser, -1 when removed
+};
+
+// Joins the effective entries of two parsed configs on their keys through the
+// parsers' key indexes, so a comparison is linear in the number of entries.
+// Items follow the left file, with keys that only exist on the right placed
+// where they appear relative to the shared keys.
+class ConfDiff
+{
+public:
+    void compare(const ConfParser &left, const ConfParser &right);
+
+    const QVector<ConfDiffItem> &items() const { return m_items; }
+    int count(ConfDiffItem::Kind kind) const { return m_counts[kind]; }
+    bool isEmpty() const { return m_counts[ConfDiffItem::Unchanged] == m_items.size(); }
+
+private:
+    void append(ConfDiffItem::Kind kind, int leftEntry, int rightEntry);
+
+    QVector<ConfDiffItem> m_items;
+    int m_counts[4] = {};
+};
@@ -0,0 +1,244 @@
+#include "confdiffdialog.h"
+
+#include <QApplication>
+#include <QBrush>
+#include <QColor>
+#include <QComboBox>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QScreen>
+#include <QTableView>
+#include <QVBoxLayout>
+
+ConfDiffModel::ConfDiffModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void ConfDiffModel::setDiff(const ConfDiff *diff, const ConfParser *left, const ConfParser *right)
+{
+    beginResetModel();
+    m_diff = diff;
+    m_left = left;
+    m_right = right;
+    rebuildRows();
+    endResetModel();
+}
+
+void ConfDiffModel::setFilter(Filter filter)
+{
+    if (m_filter == filter)
+        return;
+    beginResetModel();
+    m_filter = filter;
+    rebuildRows();
+    endResetModel();
+}
+
+void ConfDiffModel::rebuildRows()
+{
+    m_rows.clear();
+    if (!m_diff)
+        return;
+
+    const QVector<ConfDiffItem> &items = m_diff->items();
+    m_rows.reserve(items.size());
+    for (int i = 0; i < items.size(); ++i)
+    {
+        const ConfDiffItem::Kind kind = items[i].kind;
+        bool accept = false;
+        switch (m_filter)
+        {
+        case AllItems: accept = true; break;
+        case Differences: accept = kind != ConfDiffItem::Unchanged; break;
+        case AddedOnly: accept = kind == ConfDiffItem::Added; break;
+        case RemovedOnly: accept = kind == ConfDiffItem::Removed; break;
+        case ChangedOnly: accept = kind == ConfDiffItem::Changed; break;
+        }
+        if (accept)
+            m_rows.push_back(i);
+    }
+}
+
+int ConfDiffModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return m_rows.size();
+}
+
+int ConfDiffModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return 4;
+}
+
+QVariant ConfDiffModel::data(const QModelIndex &index, int role) const
+{
+    if (!m_diff || !index.isValid() || index.row() >= m_rows.size())
+        return QVariant();
+
+    const ConfDiffItem &item = m_diff->items()[m_rows[index.row()]];
+    const ConfigEntry *left = item.leftEntry >= 0 ? &m_left->entries()[item.leftEntry] : nullptr;
+    const ConfigEntry *right = item.rightEntry >= 0 ? &m_right->entries()[item.rightEntry] : nullptr;
+
+    if (role == Qt::DisplayRole || role == Qt::ToolTipRole)
+    {
+        switch (index.column())
+        {
+        case 0:
+            switch (item.kind)
+            {
+            case ConfDiffItem::Unchanged: return QString("相同");
+            case ConfDiffItem::Changed: return QString("修改");
+            case ConfDiffItem::Added: return QString("新增");
+            case ConfDiffItem::Removed: return QString("删除");
+            }
+            break;
+        case 1: return left ? left->key : right->key;
+        case 2: return left ? left->value : QString();
+        case 3: return right ? right->value : QString();
+        default: break;
+        }
+    }
+
+    if (role == Qt::ForegroundRole && index.column() == 0)
+    {
+        switch (item.kind)
+        {
+        case ConfDiffItem::Changed: return QBrush(QColor(196, 120, 30));
+        case ConfDiffItem::Added: return QBrush(QColor(40, 150, 90));
+        case ConfDiffItem::Removed: return QBrush(QColor(200, 60, 80));
+        default: break;
+        }
+    }
+
+    if (role == Qt::TextAlignmentRole)
+    {
+        if (index.column() == 1)
+            return QVariant(Qt::AlignLeft | Qt::AlignVCenter);
+        return QVariant(Qt::AlignCenter);
+    }
+
+    return QVariant();
+}
+
+QVariant ConfDiffModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal)
+    {
+        if (role == Qt::DisplayRole)
+        {
+            switch (section)
+            {
+            case 0: return QString("状态");
+            case 1: return QString("键名");
+            case 2: return QString("当前值");
+            case 3: return QString("对比值");
+            default: break;
+            }
+        }
+        if (role == Qt::TextAlignmentRole)
+        {
+            return QVariant(Qt::AlignCenter);
+        }
+    }
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
+
+ConfDiffDialog::ConfDiffDialog(QWidget *parent)
+    : QDialog(parent)
+{
+    setObjectName("DiffDialog");
+    setWindowTitle("配置对比");
+    setModal(true);
+
+    // Target: 70% of the screen, leaving room for long values
+    QRect screenGeometry = QApplication::primaryScreen()->availableGeometry();
+    resize(qBound(700, static_cast<int>(screenGeometry.width() * 0.7), 1400),
+           qBound(500, static_cast<int>(screenGeometry.height() * 0.7), 900));
+
+    buildUi();
+}
+
+void ConfDiffDialog::buildUi()
+{
+    QVBoxLayout *mainLayout = new QVBoxLayout(this);
+    mainLayout->setContentsMargins(24, 24, 24, 24);
+    mainLayout->setSpacing(16);
+
+    QHBoxLayout *toolbarLayout = new QHBoxLayout();
+    toolbarLayout->setSpacing(8);
+
+    m_summaryLabel = new QLabel(this);
+    toolbarLayout->addWidget(m_summaryLabel, 1);
+
+    m_filterCombo = new QComboBox(this);
+    m_filterCombo->addItem("仅显示差异", ConfDiffModel::Differences);
+    m_filterCombo->addItem("全部", ConfDiffModel::AllItems);
+    m_filterCombo->addItem("新增", ConfDiffModel::AddedOnly);
+    m_filterCombo->addItem("删除", ConfDiffModel::RemovedOnly);
+    m_filterCombo->addItem("修改", ConfDiffModel::ChangedOnly);
+    toolbarLayout->addWidget(m_filterCombo);
+
+    mainLayout->addLayout(toolbarLayout);
+
+    m_model = new ConfDiffModel(this);
+
+    m_table = new QTableView(this);
+    m_table->setModel(m_model);
+    m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_table->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_table->setAlternatingRowColors(true);
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setWordWrap(false);
+    m_table->verticalHeader()->setVisible(false);
+    // Fixed row heights keep scrolling independent of the row count
+    m_table->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    m_table->verticalHeader()->setDefaultSectionSize(32);
+    m_table->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    m_table->horizontalHeader()->setStretchLastSection(true);
+    m_table->setColumnWidth(0, 80);
+    m_table->setColumnWidth(1, 320);
+    m_table->setColumnWidth(2, 260);
+    mainLayout->addWidget(m_table, 1);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    buttonLayout->addStretch();
+    QPushButton *closeButton = new QPushButton("关闭", this);
+    closeButton->setObjectName("PrimaryButton");
+    closeButton->setCursor(Qt::PointingHandCursor);
+    buttonLayout->addWidget(closeButton);
+    mainLayout->addLayout(buttonLayout);
+
+    connect(m_filterCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        m_model->setFilter(static_cast<ConfDiffModel::Filter>(m_filterCombo->currentData().toInt()));
+    });
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::accept);
+}
+
+bool ConfDiffDialog::compare(const ConfParser &current, const QString &otherPath, QString *error)
+{
+    if (!m_other.load(otherPath, error))
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    m_diff.compare(current, m_other);
+    const qint64 elapsed = timer.elapsed();
+
+    m_model->setDiff(&m_diff, &current, &m_other);
+    setWindowTitle(QString("配置对比 - %1").arg(QFileInfo(otherPath).fileName()));
+    m_summaryLabel->setText(QString("新增 %1 · 删除 %2 · 修改 %3 · 相同 %4（%5 毫秒）")
+                                .arg(m_diff.count(ConfDiffItem::Added))
+                                .arg(m_diff.count(ConfDiffItem::Removed))
+                                .arg(m_diff.count(ConfDiffItem::Changed))
+                                .arg(m_diff.count(ConfDiffItem::Unchanged))
+                                .arg(elapsed));
+    return true;
+}
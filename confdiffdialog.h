@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QDialog>
+
+#include "confdiff.h"
+#include "confparser.h"
+
+class QComboBox;
+class QLabel;
+class QTableView;
+
+// Rows of a ConfDiff, filtered by kind. Cells are built on demand, so the
+// view only ever touches the rows it shows.
+class ConfDiffModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Filter
+    {
+        AllItems,
+        Differences,
+        AddedOnly,
+        RemovedOnly,
+        ChangedOnly
+    };
+
+    explicit ConfDiffModel(QObject *parent = nullptr);
+
+    void setDiff(const ConfDiff *diff, const ConfParser *left, const ConfParser *right);
+    void setFilter(Filter filter);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    void rebuildRows();
+
+    const ConfDiff *m_diff = nullptr;
+    const ConfParser *m_left = nullptr;
+    const ConfParser *m_right = nullptr;
+    Filter m_filter = Differences;
+    QVector<int> m_rows;   // Item indexes in m_diff that pass the filter
+};
+
+class ConfDiffDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ConfDiffDialog(QWidget *parent = nullptr);
+
+    // Compares the loaded config with the file at otherPath (typically its .dist)
+    bool compare(const ConfParser &current, const QString &otherPath, QString *error);
+
+private:
+    void buildUi();
+
+    ConfParser m_other;
+    ConfDiff m_diff;
+    ConfDiffModel *m_model = nullptr;
+    QLabel *m_summaryLabel = nullptr;
+    QComboBox *m_filterCombo = nullptr;
+    QTableView *m_table = nullptr;
+};
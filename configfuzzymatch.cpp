@@ -0,0 +1,179 @@
+#include "configfuzzymatch.h"
+
+#include <QVarLengthArray>
+
+#include <utility>
+
+// Baseline on x86-64; the build enables no wider instruction sets
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CONFIGFUZZY_SSE2
+#endif
+
+namespace {
+
+const int kNone = -(1 << 20);
+const int kMatch = 16;
+const int kConsecutive = 8;
+const int kGapStart = 3;
+const int kGapExtension = 1;
+const int kBonusStart = 24;       // First character, or first after '.'
+const int kBonusSeparator = 16;   // After '_', '-', ' ' or ':'
+const int kBonusCamel = 12;       // Lower to upper case, letter to digit
+
+using QueryChars = QVarLengthArray<QChar, 64>;
+
+QueryChars queryChars(const QString &foldedQuery)
+{
+    QueryChars chars;
+    for (QChar ch : foldedQuery)
+    {
+        if (!ch.isSpace())
+            chars.append(ch);
+    }
+    return chars;
+}
+
+inline int maskBit(QChar ch)
+{
+    const ushort c = ch.toCaseFolded().unicode();
+    if (c >= 'a' && c <= 'z')
+        return c - 'a';
+    if (c >= '0' && c <= '9')
+        return 26 + (c - '0');
+    if (c < 0x80)
+        return 36 + c % 8;
+    return 44 + c % 20;
+}
+
+int boundaryBonus(const QString &text, int pos)
+{
+    if (pos == 0)
+        return kBonusStart;
+    const QChar prev = text[pos - 1];
+    const QChar ch = text[pos];
+    if (prev == QLatin1Char('.'))
+        return kBonusStart;
+    if (prev == QLatin1Char('_') || prev == QLatin1Char('-') || prev == QLatin1Char(':') || prev.isSpace())
+        return kBonusSeparator;
+    if ((prev.isLower() && ch.isUpper()) || (prev.isLetter() && ch.isDigit()))
+        return kBonusCamel;
+    return 0;
+}
+
+} // namespace
+
+quint64 ConfigFuzzyMatcher::charMask(const QString &text)
+{
+    quint64 mask = 0;
+    for (QChar ch : text)
+    {
+        if (!ch.isSpace())
+            mask |= quint64(1) << maskBit(ch);
+    }
+    return mask;
+}
+
+// A row passes when no query bit is missing from its mask: (~row & query) == 0
+void ConfigFuzzyMatcher::prefilter(const quint64 *masks, int count, quint64 queryMask, QVector<quint64> *bits)
+{
+    bits->fill(0, (count + 63) / 64);
+    quint64 *out = bits->data();
+    int i = 0;
+
+#if defined(CONFIGFUZZY_SSE2)
+    // SSE2 has no 64-bit compare: a row passes when all eight of its bytes are zero
+    const __m128i query = _mm_set1_epi64x(static_cast<qint64>(queryMask));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i *>(masks + i));
+        const int zeroBytes = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_andnot_si128(rows, query), zero));
+        const int pass = ((zeroBytes & 0x00ff) == 0x00ff ? 1 : 0) | ((zeroBytes & 0xff00) == 0xff00 ? 2 : 0);
+        out[i >> 6] |= quint64(pass) << (i & 63);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        if (!(queryMask & ~masks[i]))
+            out[i >> 6] |= quint64(1) << (i & 63);
+    }
+}
+
+// best[j] is the top score with the current query character matched at
+// text position j. Reaching j from a match at k < j - 1 costs the gap; the
+// best of those is carried along in one pass instead of scanning every k.
+int ConfigFuzzyMatcher::score(const QString &foldedQuery, const QString &text)
+{
+    const QueryChars query = queryChars(foldedQuery);
+    const int n = query.size();
+    const int m = text.size();
+    if (n == 0)
+        return 0;
+    if (n > m)
+        return -1;
+
+    QVarLengthArray<QChar, 128> folded(m);
+    for (int j = 0; j < m; ++j)
+        folded[j] = text[j].toCaseFolded();
+
+    int matched = 0;
+    for (int j = 0; j < m && matched < n; ++j)
+    {
+        if (folded[j] == query[matched])
+            ++matched;
+    }
+    if (matched < n)
+        return -1;
+
+    QVarLengthArray<int, 384> buffer(3 * m);
+    int *bonus = buffer.data();
+    int *previous = bonus + m;
+    int *current = previous + m;
+    for (int j = 0; j < m; ++j)
+    {
+        bonus[j] = boundaryBonus(text, j);
+        previous[j] = folded[j] == query[0] ? kMatch + bonus[j] : kNone;
+    }
+
+    for (int i = 1; i < n; ++i)
+    {
+        int gapBest = kNone;
+        for (int j = 0; j < m; ++j)
+        {
+            if (gapBest != kNone)
+                gapBest -= kGapExtension;
+            if (j >= 2 && previous[j - 2] != kNone)
+                gapBest = qMax(gapBest, previous[j - 2] - kGapStart);
+
+            current[j] = kNone;
+            if (j == 0 || folded[j] != query[i])
+                continue;
+            int best = gapBest;
+            if (previous[j - 1] != kNone)
+                best = qMax(best, previous[j - 1] + kConsecutive);
+            if (best != kNone)
+                current[j] = best + kMatch + bonus[j];
+        }
+        std::swap(previous, current);
+    }
+
+    int best = kNone;
+    for (int j = 0; j < m; ++j)
+        best = qMax(best, previous[j]);
+    return best == kNone ? -1 : qMax(best, 0);
+}
+
+bool ConfigFuzzyMatcher::narrows(const QString &a, const QString &b)
+{
+    const QueryChars shorter = queryChars(a);
+    const QueryChars longer = queryChars(b);
+    int matched = 0;
+    for (int j = 0; j < longer.size() && matched < shorter.size(); ++j)
+    {
+        if (longer[j] == shorter[matched])
+            ++matched;
+    }
+    return matched == shorter.size();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+// Subsequence matching for the fuzzy search mode: "mapupthr" finds
+// "MapUpdate.Threads". Every row carries a 64-bit mask of the characters it
+// contains, so rows missing a query character are rejected in bulk (two rows
+// at a time with SSE2) before any scoring.
+class ConfigFuzzyMatcher
+{
+public:
+    // Characters of text, folded and hashed into 64 bits; spaces are ignored
+    static quint64 charMask(const QString &text);
+
+    // Sets bit i of bits (count bits, rounded up to whole words) when masks[i]
+    // has every bit of queryMask
+    static void prefilter(const quint64 *masks, int count, quint64 queryMask, QVector<quint64> *bits);
+
+    // Score of the best alignment of the folded query (spaces removed) as a
+    // subsequence of text, higher is better; -1 when it is not a subsequence.
+    // Matches at the start, after '.', after '_' / '-' / ' ' and at camel case
+    // humps earn bonuses, runs of consecutive matches too, gaps cost a little.
+    static int score(const QString &foldedQuery, const QString &text);
+
+    // True when every row matching b also matches a, i.e. a is a subsequence of b
+    static bool narrows(const QString &a, const QString &b);
+};
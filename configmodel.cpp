@@ -1,6 +1,15 @@
 #include "configmodel.h"
 
+#include "configfuzzymatch.h"
+
+#include <QFutureWatcher>
+#include <QSharedPointer>
 #include <QStringList>
+#include <QtAlgorithms>
+#include <QtConcurrent>
+
+// Result sets ConfigFilterProxy keeps for backspacing and narrowing
+static const int kRecentSearchLimit = 16;
 
 ConfigModel::ConfigModel(QObject *parent)
     : QAbstractTableModel(parent)
@@ -11,7 +20,155 @@ void ConfigModel::setEntries(QVector<ConfigEntry> *entries)
 {
     beginResetModel();
     m_entries = entries;
+    m_searchKeys.clear();
+    m_entryKeys.clear();
+    m_entryNames.clear();
+    m_fuzzyMasks.clear();
+    if (m_entries)
+    {
+        m_searchKeys.reserve(m_entries->size());
+        m_entryKeys.reserve(m_entries->size());
+        m_entryNames.reserve(m_entries->size());
+        m_fuzzyMasks.reserve(m_entries->size());
+        for (const ConfigEntry &entry : *m_entries)
+        {
+            m_searchKeys.push_back(buildSearchKey(entry));
+            m_entryKeys.push_back(entry.key);
+            m_entryNames.push_back(entry.nameZh);
+            m_fuzzyMasks.push_back(ConfigFuzzyMatcher::charMask(entry.key) | ConfigFuzzyMatcher::charMask(entry.nameZh));
+        }
+    }
     endResetModel();
+    // After the reset: proxies restart their search from searchIndexChanged,
+    // which must not happen while the reset is still in progress
+    rebuildSearchIndex();
+}
+
+// The index is built on a worker thread from a snapshot of the keys; until it
+// is back, searches scan every row. Rows edited meanwhile are patched in when
+// it arrives.
+void ConfigModel::rebuildSearchIndex()
+{
+    m_indexReady = false;
+    m_rowsChangedDuringBuild.clear();
+    const int generation = ++m_indexGeneration;
+    emit searchIndexChanged();
+    if (m_searchKeys.isEmpty())
+        return;
+
+    const QVector<QString> keys = m_searchKeys;
+    auto watcher = new QFutureWatcher<QSharedPointer<ConfigSearchIndex>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, keys, generation]() {
+        QSharedPointer<ConfigSearchIndex> index = watcher->result();
+        watcher->deleteLater();
+        if (generation != m_indexGeneration)
+            return;
+
+        m_index = std::move(*index);
+        for (int row : m_rowsChangedDuringBuild)
+            m_index.updateRow(row, keys[row], m_searchKeys[row]);
+        m_rowsChangedDuringBuild.clear();
+        m_indexReady = true;
+        emit searchIndexChanged();
+    });
+    watcher->setFuture(QtConcurrent::run([keys]() {
+        QSharedPointer<ConfigSearchIndex> index(new ConfigSearchIndex());
+        index->build(keys);
+        return index;
+    }));
+}
+
+bool ConfigModel::searchCandidates(const QString &foldedText, QVector<quint64> *bits) const
+{
+    return m_indexReady && m_index.candidates(foldedText, bits);
+}
+
+ConfigSearchSnapshot ConfigModel::searchSnapshot() const
+{
+    ConfigSearchSnapshot snapshot;
+    snapshot.keys = m_searchKeys;
+    snapshot.index = m_index;
+    snapshot.indexReady = m_indexReady;
+    snapshot.entryKeys = m_entryKeys;
+    snapshot.entryNames = m_entryNames;
+    snapshot.fuzzyMasks = m_fuzzyMasks;
+    return snapshot;
+}
+
+QVector<quint64> ConfigSearchSnapshot::match(const QString &foldedText, const QVector<quint64> &within,
+                                             const QAtomicInt *latest, int generation) const
+{
+    const int words = (keys.size() + 63) / 64;
+    // Narrowing an earlier result only costs as much as that result is large
+    QVector<quint64> candidates = within;
+    const bool useCandidates = within.size() == words || (indexReady && index.candidates(foldedText, &candidates));
+
+    QVector<quint64> accepted(words, 0);
+    for (int w = 0; w < words; ++w)
+    {
+        if ((w & 15) == 0 && latest->loadAcquire() != generation)
+            return QVector<quint64>();
+
+        quint64 rows = useCandidates ? candidates[w] : ~quint64(0);
+        while (rows)
+        {
+            const int bit = qCountTrailingZeroBits(rows);
+            rows &= rows - 1;
+            const int row = w * 64 + bit;
+            if (row >= keys.size())
+                break;
+            if (keys[row].contains(foldedText))
+                accepted[w] |= quint64(1) << bit;
+        }
+    }
+    return accepted;
+}
+
+// The character masks rule out most rows before any of them is scored
+ConfigSearchResult ConfigSearchSnapshot::matchFuzzy(const QString &foldedText, const QVector<quint64> &within,
+                                                    const QAtomicInt *latest, int generation) const
+{
+    const int rowCount = fuzzyMasks.size();
+    const int words = (rowCount + 63) / 64;
+    QVector<quint64> candidates;
+    ConfigFuzzyMatcher::prefilter(fuzzyMasks.constData(), rowCount, ConfigFuzzyMatcher::charMask(foldedText), &candidates);
+    if (within.size() == words)
+    {
+        for (int w = 0; w < words; ++w)
+            candidates[w] &= within[w];
+    }
+
+    QVector<quint64> accepted(words, 0);
+    QVector<int> scores(rowCount, -1);
+    for (int w = 0; w < words; ++w)
+    {
+        if ((w & 15) == 0 && latest->loadAcquire() != generation)
+            return ConfigSearchResult();
+
+        quint64 rows = candidates[w];
+        while (rows)
+        {
+            const int bit = qCountTrailingZeroBits(rows);
+            rows &= rows - 1;
+            const int row = w * 64 + bit;
+            const int score = qMax(ConfigFuzzyMatcher::score(foldedText, entryKeys[row]),
+                                   ConfigFuzzyMatcher::score(foldedText, entryNames[row]));
+            if (score < 0)
+                continue;
+            accepted[w] |= quint64(1) << bit;
+            scores[row] = score;
+        }
+    }
+
+    ConfigSearchResult result;
+    result.accepted = accepted;
+    result.scores = scores;
+    return result;
+}
+
+QString ConfigModel::buildSearchKey(const ConfigEntry &entry)
+{
+    return QString("%1 %2 %3").arg(entry.key, entry.nameZh, entry.descriptionZh).toCaseFolded();
 }
 
 int ConfigModel::rowCount(const QModelIndex &parent) const
@@ -107,22 +264,207 @@ const ConfigEntry &ConfigModel::entryAt(int row) const
 
 void ConfigModel::notifyRowChanged(int row)
 {
-    if (!m_entries)
+    notifyRowsChanged({row});
+}
+
+// Proxies restart their search on searchIndexChanged and take a new snapshot of
+// the keys, so it is emitted once for the whole batch: per row, every restart
+// would make the next row's update detach the vectors from the snapshot again
+void ConfigModel::notifyRowsChanged(const QVector<int> &rows)
+{
+    if (!m_entries || rows.isEmpty())
         return;
-    QModelIndex left = index(row, 0);
-    QModelIndex right = index(row, columnCount() - 1);
+
+    int first = rows.first();
+    int last = first;
+    for (int row : rows)
+    {
+        const ConfigEntry &entry = (*m_entries)[row];
+        const QString oldKey = m_searchKeys[row];
+        m_searchKeys[row] = buildSearchKey(entry);
+        m_entryKeys[row] = entry.key;
+        m_entryNames[row] = entry.nameZh;
+        m_fuzzyMasks[row] = ConfigFuzzyMatcher::charMask(entry.key) | ConfigFuzzyMatcher::charMask(entry.nameZh);
+        if (m_indexReady)
+            m_index.updateRow(row, oldKey, m_searchKeys[row]);
+        else
+            m_rowsChangedDuringBuild.insert(row);
+        first = qMin(first, row);
+        last = qMax(last, row);
+    }
+    emit searchIndexChanged();
+
+    QModelIndex left = index(first, 0);
+    QModelIndex right = index(last, columnCount() - 1);
     emit dataChanged(left, right, {Qt::DisplayRole});
 }
 
 ConfigFilterProxy::ConfigFilterProxy(QObject *parent)
     : QSortFilterProxyModel(parent)
+    , m_generation(new QAtomicInt(0))
 {
 }
 
+void ConfigFilterProxy::setSourceModel(QAbstractItemModel *model)
+{
+    if (ConfigModel *old = qobject_cast<ConfigModel *>(sourceModel()))
+    {
+        disconnect(old, &ConfigModel::searchIndexChanged, this, nullptr);
+        disconnect(old, &QAbstractItemModel::modelAboutToBeReset, this, nullptr);
+    }
+    if (ConfigModel *configModel = qobject_cast<ConfigModel *>(model))
+    {
+        connect(configModel, &ConfigModel::searchIndexChanged, this, &ConfigFilterProxy::onSearchIndexChanged);
+        connect(configModel, &QAbstractItemModel::modelAboutToBeReset, this, &ConfigFilterProxy::onSourceAboutToBeReset);
+    }
+    QSortFilterProxyModel::setSourceModel(model);
+    onSearchIndexChanged();
+}
+
 void ConfigFilterProxy::setSearchText(const QString &text)
 {
-    m_searchText = text.trimmed();
-    invalidateFilter();
+    m_searchText = text.trimmed().toCaseFolded();
+    startSearch();
+}
+
+// Each keystroke bumps the generation: a running match notices and stops, and
+// a result that arrives late is dropped
+void ConfigFilterProxy::startSearch()
+{
+    const int generation = m_generation->fetchAndAddOrdered(1) + 1;
+    const ConfigModel *model = qobject_cast<const ConfigModel *>(sourceModel());
+    if (!model || m_searchText.isEmpty())
+    {
+        applySearch(m_searchText, ConfigSearchResult(), false, m_fuzzy);
+        return;
+    }
+
+    // A query seen before (e.g. after a backspace) is answered from the cache.
+    // Otherwise the longest earlier query it contains limits the rows to test:
+    // a row matching "mapu" also matches "map". In fuzzy mode "containing" is
+    // having the earlier query as a subsequence.
+    const CachedSearch *narrowest = nullptr;
+    for (int i = 0; i < m_recentSearches.size(); ++i)
+    {
+        const CachedSearch &cached = m_recentSearches[i];
+        if (cached.text == m_searchText)
+        {
+            const CachedSearch hit = cached;
+            rememberSearch(hit.text, hit.result);
+            applySearch(hit.text, hit.result, true, m_fuzzy);
+            return;
+        }
+        const bool narrows = m_fuzzy ? ConfigFuzzyMatcher::narrows(cached.text, m_searchText)
+                                     : m_searchText.contains(cached.text);
+        if (narrows && (!narrowest || cached.text.size() > narrowest->text.size()))
+            narrowest = &cached;
+    }
+
+    const ConfigSearchSnapshot snapshot = model->searchSnapshot();
+    const QString text = m_searchText;
+    const bool fuzzy = m_fuzzy;
+    const QVector<quint64> within = narrowest ? narrowest->result.accepted : QVector<quint64>();
+    const QSharedPointer<QAtomicInt> latest = m_generation;
+    auto watcher = new QFutureWatcher<ConfigSearchResult>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, text, fuzzy, generation]() {
+        const ConfigSearchResult result = watcher->result();
+        watcher->deleteLater();
+        if (generation != m_generation->loadAcquire())
+            return;
+        rememberSearch(text, result);
+        applySearch(text, result, true, fuzzy);
+    });
+    watcher->setFuture(QtConcurrent::run([snapshot, text, fuzzy, within, latest, generation]() {
+        if (fuzzy)
+            return snapshot.matchFuzzy(text, within, latest.data(), generation);
+        ConfigSearchResult result;
+        result.accepted = snapshot.match(text, within, latest.data(), generation);
+        return result;
+    }));
+}
+
+void ConfigFilterProxy::rememberSearch(const QString &text, const ConfigSearchResult &result)
+{
+    for (int i = 0; i < m_recentSearches.size(); ++i)
+    {
+        if (m_recentSearches[i].text == text)
+        {
+            m_recentSearches.remove(i);
+            break;
+        }
+    }
+    CachedSearch cached;
+    cached.text = text;
+    cached.result = result;
+    m_recentSearches.prepend(cached);
+    if (m_recentSearches.size() > kRecentSearchLimit)
+        m_recentSearches.resize(kRecentSearchLimit);
+}
+
+// Fuzzy results are ranked by score: the proxy sorts on column 0 through
+// lessThan() and goes back to file order otherwise
+void ConfigFilterProxy::applySearch(const QString &text, const ConfigSearchResult &result, bool valid, bool fuzzy)
+{
+    m_appliedText = text;
+    m_appliedFuzzy = fuzzy;
+    m_accepted = result.accepted;
+    m_scores = result.scores;
+    m_acceptedValid = valid;
+    updateCandidates();
+
+    const bool ranked = valid && !m_scores.isEmpty();
+    if (ranked != (sortColumn() == 0))
+        sort(ranked ? 0 : -1);
+    if (ranked)
+        invalidate();
+    else
+        invalidateFilter();
+}
+
+void ConfigFilterProxy::setFuzzy(bool fuzzy)
+{
+    if (fuzzy == m_fuzzy)
+        return;
+    m_fuzzy = fuzzy;
+    m_recentSearches.clear();
+    startSearch();
+}
+
+// Rows changed after the snapshot: filter row by row until a new result is in.
+// The scores belong to the old rows too, so the ranking is dropped with them.
+void ConfigFilterProxy::onSearchIndexChanged()
+{
+    m_acceptedValid = false;
+    m_recentSearches.clear();
+    m_scores.clear();
+    if (sortColumn() != -1)
+        sort(-1);
+    updateCandidates();
+    if (!m_searchText.isEmpty())
+        startSearch();
+}
+
+// The reset re-filters and re-sorts the new rows: the result, scores and
+// candidates describe the old ones, so the rows are tested one by one and kept
+// in file order until searchIndexChanged starts a new search
+void ConfigFilterProxy::onSourceAboutToBeReset()
+{
+    m_acceptedValid = false;
+    m_scores.clear();
+    m_candidates.clear();
+    m_useCandidates = false;
+}
+
+void ConfigFilterProxy::updateCandidates()
+{
+    const ConfigModel *model = qobject_cast<const ConfigModel *>(sourceModel());
+    // Only the row-by-row fallback needs candidates: a valid result already
+    // answers every row, so the GUI thread skips the posting list intersection.
+    // The n-gram index only narrows substring searches.
+    m_useCandidates = model && !m_acceptedValid && !m_appliedFuzzy && !m_appliedText.isEmpty()
+                      && model->searchCandidates(m_appliedText, &m_candidates);
+    if (!m_useCandidates)
+        m_candidates.clear();
 }
 
 void ConfigFilterProxy::setSectionFilter(const QString &section)
@@ -149,9 +491,25 @@ bool ConfigFilterProxy::filterAcceptsRow(int sourceRow, const QModelIndex &sourc
             return false;
     }
 
-    if (m_searchText.isEmpty())
+    if (m_appliedText.isEmpty())
         return true;
 
-    const QString haystack = QString("%1 %2 %3").arg(entry.key, entry.nameZh, entry.descriptionZh).toLower();
-    return haystack.contains(m_searchText.toLower());
+    const quint64 bit = quint64(1) << (sourceRow & 63);
+    if (m_acceptedValid && (sourceRow >> 6) < m_accepted.size())
+        return m_accepted[sourceRow >> 6] & bit;
+    if (m_appliedFuzzy)
+        return ConfigFuzzyMatcher::score(m_appliedText, entry.key) >= 0
+               || ConfigFuzzyMatcher::score(m_appliedText, entry.nameZh) >= 0;
+    if (m_useCandidates && !(m_candidates[sourceRow >> 6] & bit))
+        return false;
+    return model->searchKey(sourceRow).contains(m_appliedText);
+}
+
+bool ConfigFilterProxy::lessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+    const int leftRow = left.row();
+    const int rightRow = right.row();
+    if (leftRow < m_scores.size() && rightRow < m_scores.size() && m_scores[leftRow] != m_scores[rightRow])
+        return m_scores[leftRow] > m_scores[rightRow];
+    return leftRow < rightRow;
 }
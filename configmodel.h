@@ -1,9 +1,40 @@
 #pragma once
 
 #include <QAbstractTableModel>
+#include <QAtomicInt>
+#include <QSet>
+#include <QSharedPointer>
 #include <QSortFilterProxyModel>
 
 #include "confparser.h"
+#include "configsearchindex.h"
+
+struct ConfigSearchResult
+{
+    QVector<quint64> accepted;   // One bit per row; empty when the search was cancelled
+    QVector<int> scores;         // Fuzzy mode only: score per row, -1 for rows left out
+};
+
+// What a search needs from ConfigModel, copied so a worker thread can match
+// while the model keeps changing; the copy only shares the model's data
+struct ConfigSearchSnapshot
+{
+    QVector<QString> keys;
+    ConfigSearchIndex index;
+    bool indexReady = false;
+    QVector<QString> entryKeys;     // Fuzzy targets, original case
+    QVector<QString> entryNames;
+    QVector<quint64> fuzzyMasks;    // ConfigFuzzyMatcher::charMask of key and name
+
+    // Bit i is set when row i contains the folded text. Only the rows set in
+    // within are tested unless it is empty. Gives up and returns an empty
+    // vector once *latest no longer equals generation.
+    QVector<quint64> match(const QString &foldedText, const QVector<quint64> &within,
+                           const QAtomicInt *latest, int generation) const;
+    // Same for a subsequence of the key or the name, with every match scored
+    ConfigSearchResult matchFuzzy(const QString &foldedText, const QVector<quint64> &within,
+                                  const QAtomicInt *latest, int generation) const;
+};
 
 class ConfigModel : public QAbstractTableModel
 {
@@ -22,9 +53,34 @@ public:
 
     const ConfigEntry &entryAt(int row) const;
     void notifyRowChanged(int row);
+    // One searchIndexChanged and one dataChanged covering every row
+    void notifyRowsChanged(const QVector<int> &rows);
+
+    // "key nameZh descriptionZh", case folded; rebuilt when the row changes
+    const QString &searchKey(int row) const { return m_searchKeys[row]; }
+    // Rows that may contain the folded text, from the n-gram index. Returns
+    // false while the index is being rebuilt or when text is too short; every
+    // row has to be checked then.
+    bool searchCandidates(const QString &foldedText, QVector<quint64> *bits) const;
+    ConfigSearchSnapshot searchSnapshot() const;
+
+signals:
+    // The search keys or the index changed; cached candidates are stale
+    void searchIndexChanged();
 
 private:
+    static QString buildSearchKey(const ConfigEntry &entry);
+    void rebuildSearchIndex();
+
     QVector<ConfigEntry> *m_entries = nullptr;
+    QVector<QString> m_searchKeys;
+    QVector<QString> m_entryKeys;
+    QVector<QString> m_entryNames;
+    QVector<quint64> m_fuzzyMasks;
+    ConfigSearchIndex m_index;
+    bool m_indexReady = false;
+    int m_indexGeneration = 0;
+    QSet<int> m_rowsChangedDuringBuild;
 };
 
 class ConfigFilterProxy : public QSortFilterProxyModel
@@ -34,13 +90,43 @@ class ConfigFilterProxy : public QSortFilterProxyModel
 public:
     explicit ConfigFilterProxy(QObject *parent = nullptr);
 
+    void setSourceModel(QAbstractItemModel *model) override;
+
+    // Matching runs on a worker thread; the filter changes once the result is in
     void setSearchText(const QString &text);
     void setSectionFilter(const QString &section);
+    // Subsequence matching on keys and names, best matches first
+    void setFuzzy(bool fuzzy);
+    bool isFuzzy() const { return m_fuzzy; }
 
 protected:
     bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+    bool lessThan(const QModelIndex &left, const QModelIndex &right) const override;
 
 private:
-    QString m_searchText;
+    struct CachedSearch
+    {
+        QString text;
+        ConfigSearchResult result;
+    };
+
+    void startSearch();
+    void rememberSearch(const QString &text, const ConfigSearchResult &result);
+    void applySearch(const QString &text, const ConfigSearchResult &result, bool valid, bool fuzzy);
+    void onSearchIndexChanged();
+    void onSourceAboutToBeReset();
+    void updateCandidates();
+
+    QString m_searchText;            // Case folded, as last typed
+    QString m_appliedText;           // Case folded, what the filter currently shows
     QString m_sectionFilter;
+    bool m_fuzzy = false;
+    bool m_appliedFuzzy = false;
+    QVector<quint64> m_accepted;     // Rows matching m_appliedText, one bit each
+    QVector<int> m_scores;           // Fuzzy scores of the applied result; sorts the rows
+    bool m_acceptedValid = false;    // False once the model changed after the snapshot
+    QVector<quint64> m_candidates;   // Index candidates for the row-by-row fallback
+    bool m_useCandidates = false;
+    QSharedPointer<QAtomicInt> m_generation;   // Bumped per search; older ones stop
+    QVector<CachedSearch> m_recentSearches;    // Most recent first, for the current snapshot and mode
 };
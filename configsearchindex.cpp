@@ -0,0 +1,134 @@
+#include "configsearchindex.h"
+
+#include <algorithm>
+
+namespace {
+
+const quint64 kTrigramTag = quint64(1) << 32;
+
+inline bool isAscii(QChar ch)
+{
+    return ch.unicode() < 0x80;
+}
+
+inline quint64 bigram(QChar a, QChar b)
+{
+    return (quint64(a.unicode()) << 16) | b.unicode();
+}
+
+inline quint64 trigram(QChar a, QChar b, QChar c)
+{
+    return kTrigramTag | (quint64(a.unicode()) << 14) | (quint64(b.unicode()) << 7) | c.unicode();
+}
+
+} // namespace
+
+QVector<quint64> ConfigSearchIndex::rowGrams(const QString &key)
+{
+    QVector<quint64> grams;
+    grams.reserve(key.size() * 2);
+    for (int i = 0; i + 1 < key.size(); ++i)
+    {
+        grams.push_back(bigram(key[i], key[i + 1]));
+        if (i + 2 < key.size() && isAscii(key[i]) && isAscii(key[i + 1]) && isAscii(key[i + 2]))
+            grams.push_back(trigram(key[i], key[i + 1], key[i + 2]));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+// Any gram of a substring is a gram of the row, so the rows holding all of
+// them are a superset of the matches. ASCII bigrams are only used when there
+// is nothing more selective.
+QVector<quint64> ConfigSearchIndex::queryGrams(const QString &text)
+{
+    QVector<quint64> grams;
+    for (int i = 0; i + 1 < text.size(); ++i)
+    {
+        if (!isAscii(text[i]) || !isAscii(text[i + 1]))
+            grams.push_back(bigram(text[i], text[i + 1]));
+        else if (i + 2 < text.size() && isAscii(text[i + 2]))
+            grams.push_back(trigram(text[i], text[i + 1], text[i + 2]));
+    }
+    if (grams.isEmpty() && text.size() >= 2)
+        grams.push_back(bigram(text[0], text[1]));
+    return grams;
+}
+
+void ConfigSearchIndex::build(const QVector<QString> &keys)
+{
+    m_postings.clear();
+    m_rowCount = keys.size();
+    // Rows are visited in order, so every posting list comes out sorted
+    for (int row = 0; row < keys.size(); ++row)
+    {
+        for (quint64 gram : rowGrams(keys[row]))
+            m_postings[gram].push_back(row);
+    }
+}
+
+void ConfigSearchIndex::updateRow(int row, const QString &oldKey, const QString &newKey)
+{
+    if (row < 0 || row >= m_rowCount)
+        return;
+
+    for (quint64 gram : rowGrams(oldKey))
+    {
+        auto it = m_postings.find(gram);
+        if (it == m_postings.end())
+            continue;
+        QVector<int> &rows = it.value();
+        auto pos = std::lower_bound(rows.begin(), rows.end(), row);
+        if (pos != rows.end() && *pos == row)
+            rows.erase(pos);
+        if (rows.isEmpty())
+            m_postings.erase(it);
+    }
+
+    for (quint64 gram : rowGrams(newKey))
+    {
+        QVector<int> &rows = m_postings[gram];
+        auto pos = std::lower_bound(rows.begin(), rows.end(), row);
+        if (pos == rows.end() || *pos != row)
+            rows.insert(pos, row);
+    }
+}
+
+bool ConfigSearchIndex::candidates(const QString &text, QVector<quint64> *bits) const
+{
+    const QVector<quint64> grams = queryGrams(text);
+    if (grams.isEmpty())
+        return false;
+
+    const int words = (m_rowCount + 63) / 64;
+    bits->fill(0, words);
+
+    QVector<const QVector<int> *> lists;
+    lists.reserve(grams.size());
+    for (quint64 gram : grams)
+    {
+        auto it = m_postings.constFind(gram);
+        if (it == m_postings.constEnd())
+            return true;   // A gram no row has: nothing matches
+        lists.push_back(&it.value());
+    }
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+        return a->size() < b->size();
+    });
+
+    quint64 *out = bits->data();
+    for (int row : *lists.first())
+        out[row >> 6] |= quint64(1) << (row & 63);
+
+    QVector<quint64> mask(words);
+    for (int i = 1; i < lists.size(); ++i)
+    {
+        mask.fill(0);
+        for (int row : *lists[i])
+            mask[row >> 6] |= quint64(1) << (row & 63);
+        for (int w = 0; w < words; ++w)
+            out[w] &= mask[w];
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Inverted n-gram index over the case folded search keys of ConfigModel.
+// Every character bigram (CJK names and descriptions) and every trigram of
+// ASCII characters (keys) maps to the sorted rows containing it. A query
+// intersects the posting lists of its grams as bitsets; that gives a superset
+// of the matching rows, so candidates still have to be verified.
+class ConfigSearchIndex
+{
+public:
+    void build(const QVector<QString> &keys);
+    void updateRow(int row, const QString &oldKey, const QString &newKey);
+
+    int rowCount() const { return m_rowCount; }
+
+    // Sets bit i of *bits when row i may contain text. Returns false when text
+    // is too short to have grams; every row is a candidate then.
+    bool candidates(const QString &text, QVector<quint64> *bits) const;
+
+private:
+    static QVector<quint64> rowGrams(const QString &key);
+    static QVector<quint64> queryGrams(const QString &text);
+
+    QHash<quint64, QVector<int>> m_postings;
+    int m_rowCount = 0;
+};
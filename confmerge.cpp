@@ -0,0 +1,132 @@
+#include "confmerge.h"
+#include "confparser.h"
+
+namespace {
+
+// Effective value of key in parser, or a null QString when it is not defined
+QString valueOf(const ConfParser &parser, const QString &key)
+{
+    const ConfigEntry *entry = parser.findEntry(key);
+    return entry ? entry->value : QString();
+}
+
+} // namespace
+
+ConfMergeResult ConfMerge::merge(const ConfParser &base, const ConfParser &ours, const ConfParser &theirs)
+{
+    ConfMergeResult result;
+    QByteArray &out = result.data;
+
+    const QVector<ConfLine> &lines = theirs.lines();
+    const QVector<ConfigEntry> &entries = theirs.entries();
+
+    int size = 0;
+    for (int i = 0; i < lines.size(); ++i)
+        size += theirs.lineSpan(i).length;
+    out.reserve(size + size / 16);
+
+    // Bytes before the first line (a UTF-8 BOM) come from the new template;
+    // the first line starts that many bytes into its buffer
+    if (!lines.isEmpty())
+        out.append(theirs.lineSpan(0).data - lines.first().offset, static_cast<int>(lines.first().offset));
+
+    // Entries are in line order, so one cursor walks them alongside the lines
+    int entryIndex = 0;
+    int lineNumber = 0;
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        const ConfLine &line = lines[i];
+        const ConfSpan raw = theirs.lineSpan(i);
+        ++lineNumber;
+
+        if (line.type != ConfLine::KeyValue)
+        {
+            out.append(raw.data, raw.length);
+            continue;
+        }
+
+        while (entryIndex < entries.size() && entries[entryIndex].lineIndex < i)
+            ++entryIndex;
+        const ConfigEntry &entry = entries[entryIndex];
+
+        QString merged = entry.value;
+        const ConfigEntry *current = ours.findEntry(entry.key);
+        if (current && current->value != entry.value)
+        {
+            const QString baseValue = valueOf(base, entry.key);
+            if (baseValue.isNull() || current->value != baseValue)
+            {
+                // Tuned locally; a conflict when the template moved as well
+                merged = current->value;
+                if (!baseValue.isNull() && entry.value != baseValue)
+                {
+                    ConfMergeConflict conflict;
+                    conflict.key = entry.key;
+                    conflict.baseValue = baseValue;
+                    conflict.oursValue = current->value;
+                    conflict.theirsValue = entry.value;
+                    conflict.lineNumber = lineNumber;
+                    result.conflicts.push_back(conflict);
+                }
+                else
+                {
+                    ++result.carriedValues;
+                }
+            }
+        }
+
+        if (merged == entry.value)
+        {
+            out.append(raw.data, raw.length);
+            continue;
+        }
+
+        const QByteArray value = merged.toUtf8();
+        out.append(raw.data, line.valueBegin);
+        out.append(value);
+        out.append(raw.data + line.valueBegin + line.valueLength,
+                   raw.length - static_cast<int>(line.valueBegin + line.valueLength));
+    }
+
+    // Keys the new template does not define: dropped upstream, or local additions
+    const QVector<ConfigEntry> &ourEntries = ours.entries();
+    QVector<int> customLines;
+    for (int i = 0; i < ourEntries.size(); ++i)
+    {
+        const ConfigEntry &entry = ourEntries[i];
+        if (ours.entryIndex(entry.key) != i || theirs.entryIndex(entry.key) >= 0)
+            continue;
+
+        const QString baseValue = valueOf(base, entry.key);
+        if (baseValue.isNull())
+        {
+            result.customKeys << entry.key;
+            customLines << entry.lineIndex;
+        }
+        else if (baseValue != entry.value)
+        {
+            result.droppedKeys << entry.key;
+        }
+    }
+
+    if (!customLines.isEmpty())
+    {
+        const QByteArray eol = (!lines.isEmpty() && lines.first().eolLength == 2) ? "\r\n" : "\n";
+        if (!out.isEmpty() && !out.endsWith('\n'))
+            out.append(eol);
+        out.append(eol);
+        out.append("###################################################################################################" + eol);
+        out.append("# CUSTOM SETTINGS" + eol);
+        out.append("#    Settings from the previous configuration that the template does not define." + eol);
+        out.append(eol);
+        for (int lineIndex : qAsConst(customLines))
+        {
+            const ConfSpan raw = ours.lineSpan(lineIndex);
+            out.append(raw.data, raw.length);
+            if (!out.endsWith('\n'))
+                out.append(eol);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class ConfParser;
+
+struct ConfMergeConflict
+{
+    QString key;
+    QString baseValue;      // Old template
+    QString oursValue;      // Current config; this is the value that is kept
+    QString theirsValue;    // New template
+    int lineNumber = 0;     // 1-based line in the merged output
+};
+
+struct ConfMergeResult
+{
+    QByteArray data;
+    int carriedValues = 0;              // Tuned values taken over from the current config
+    QVector<ConfMergeConflict> conflicts;
+    QStringList droppedKeys;            // Tuned keys the new template no longer has
+    QStringList customKeys;             // Keys that were never in a template; appended at the end
+};
+
+// Three-way upgrade of a config to a new template. The result follows the new
+// template line by line, keeping its layout and comments, and takes a value
+// from the current config wherever it differs from the old template. A key
+// whose value changed in both is a conflict; the current value wins.
+class ConfMerge
+{
+public:
+    static ConfMergeResult merge(const ConfParser &base, const ConfParser &ours, const ConfParser &theirs);
+};
@@ -1,7 +1,88 @@
 #include "confparser.h"
 
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if !defined(Q_OS_WIN)
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// Layout of a .confcache file: the header, the absolute config path (UTF-16),
+// the raw ConfLine array, the line index of every entry, then the section
+// names (length-prefixed UTF-16). Variable-sized parts are padded to 4 bytes.
+struct ConfCacheHeader
+{
+    char magic[8];
+    quint32 version = 0;
+    quint32 lineSize = 0;
+    qint64 fileSize = 0;
+    qint64 modified = 0;
+    qint64 changed = 0;     // Metadata change time; tools that restore mtime cannot set it
+    quint64 inode = 0;      // 0 where there is none
+    quint64 sample = 0;     // sampleHash() of the content
+    quint32 pathLength = 0;
+    quint32 lineCount = 0;
+    quint32 entryCount = 0;
+    quint32 sectionCount = 0;
+};
+
+const char kCacheMagic[8] = { 'W', 'Y', 'C', 'O', 'N', 'F', 'C', '\0' };
+const quint32 kCacheVersion = 4;
+const int kSamplePage = 4096;
+const int kSampleStride = 16;   // Every 16th page is hashed
+
+inline qint64 cacheAligned(qint64 size)
+{
+    return (size + 3) & ~qint64(3);
+}
+
+// Hash of the first page, every kSampleStride-th page and the last page; a
+// few percent of the file, enough to tell a same-size rewrite from the original
+quint64 sampleHash(const char *data, int size)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (qint64 pos = 0; pos < size; pos += qint64(kSamplePage) * kSampleStride)
+        hash.addData(data + pos, static_cast<int>(qMin<qint64>(kSamplePage, size - pos)));
+    if (size > kSamplePage)
+        hash.addData(data + size - kSamplePage, kSamplePage);
+    quint64 value = 0;
+    std::memcpy(&value, hash.result().constData(), sizeof(value));
+    return value;
+}
+
+quint64 fileInode(const QString &path)
+{
+#if !defined(Q_OS_WIN)
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) == 0)
+        return static_cast<quint64>(st.st_ino);
+#else
+    Q_UNUSED(path)
+#endif
+    return 0;
+}
+
+} // namespace
+
+// Files below this size are parsed on the calling thread
+static const int kParallelThreshold = 4 * 1024 * 1024;
+static const int kMinChunkSize = 256 * 1024;
+
+static inline bool isSpaceByte(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '\v' || ch == '\f';
+}
 
 static QString trimCommentPrefix(const QString &line)
 {
@@ -15,66 +96,543 @@ static QString trimCommentPrefix(const QString &line)
     return line.mid(i);
 }
 
-bool ConfParser::load(const QString &path, QString *error)
+// Unicode-aware header check, used for lines that are not plain ASCII
+static bool isSectionHeaderText(const QString &line)
+{
+    QString text = trimCommentPrefix(line).trimmed();
+    if (text.isEmpty())
+        return false;
+
+    if (text.contains(':'))
+        return false;
+
+    bool hasLetter = false;
+    bool allUpper = true;
+    for (QChar ch : text)
+    {
+        if (ch.isLetter())
+        {
+            hasLetter = true;
+            if (ch.toUpper() != ch)
+                allUpper = false;
+        }
+    }
+
+    if (!hasLetter || !allUpper)
+        return false;
+
+    return text.size() >= 3 && text.size() <= 80;
+}
+
+ConfParser::ConfParser() = default;
+
+ConfParser::~ConfParser() = default;
+
+void ConfParser::clear()
 {
     m_lines.clear();
     m_entries.clear();
+    m_keyIndex.clear();
+    m_pendingValues.clear();
+    m_sections.clear();
+    m_texts.clear();
+    m_arena.reset();
+    m_path.clear();
+}
+
+bool ConfParser::load(const QString &path, QString *error)
+{
+    clear();
 
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    const QString cachePath = cachePathFor(path);
+    if (!cachePath.isEmpty())
     {
-        if (error)
-            *error = QString("Failed to open config: %1").arg(path);
+        if (loadCache(path, cachePath))
+        {
+            buildKeyIndex();
+            m_path = QFileInfo(path).absoluteFilePath();
+            return true;
+        }
+        clear();
+    }
+
+    if (!m_arena.open(path, error))
         return false;
+
+    parseBuffer();
+    buildKeyIndex();
+    m_path = QFileInfo(path).absoluteFilePath();
+
+    if (!cachePath.isEmpty())
+        writeCache(path, cachePath);
+    return true;
+}
+
+void ConfParser::buildKeyIndex()
+{
+    m_keyIndex.clear();
+    m_keyIndex.reserve(m_entries.size());
+    for (int i = 0; i < m_entries.size(); ++i)
+        m_keyIndex.insert(m_entries[i].key, i);
+}
+
+const ConfigEntry *ConfParser::findEntry(const QString &key) const
+{
+    const int index = entryIndex(key);
+    return index >= 0 ? &m_entries[index] : nullptr;
+}
+
+QVector<ConfDuplicateKey> ConfParser::duplicateKeys() const
+{
+    QVector<ConfDuplicateKey> duplicates;
+    QHash<QString, int> positions;
+    for (int i = 0; i < m_entries.size(); ++i)
+    {
+        const ConfigEntry &entry = m_entries[i];
+        auto it = positions.find(entry.key);
+        if (it == positions.end())
+        {
+            // The index points at the last occurrence, so any other entry is shadowed
+            if (m_keyIndex.value(entry.key, -1) == i)
+                continue;
+            it = positions.insert(entry.key, duplicates.size());
+            ConfDuplicateKey duplicate;
+            duplicate.key = entry.key;
+            duplicates.push_back(duplicate);
+        }
+        duplicates[it.value()].lineNumbers.push_back(entry.lineIndex + 1);
+    }
+    return duplicates;
+}
+
+QString ConfParser::cachePathFor(const QString &path) const
+{
+    if (m_cacheDir.isEmpty())
+        return QString();
+    const QByteArray id = QCryptographicHash::hash(QFileInfo(path).absoluteFilePath().toUtf8(),
+                                                   QCryptographicHash::Sha1).toHex();
+    return QDir(m_cacheDir).filePath(QString::fromLatin1(id) + QStringLiteral(".confcache"));
+}
+
+// Reads a .confcache written by writeCache(). The snapshot is only used when
+// the stored path, size, modification and metadata change times, inode and
+// sampled content hash match the file on disk. `cp -p`, `rsync -t` or
+// `touch -r` can restore the size and mtime of a rewritten file, not the rest.
+// The whole content is not hashed, that would cost a good part of a parse.
+bool ConfParser::loadCache(const QString &path, const QString &cachePath)
+{
+    QFileInfo info(path);
+    QFile cache(cachePath);
+    if (!info.exists() || !cache.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 cacheSize = cache.size();
+    if (cacheSize < static_cast<qint64>(sizeof(ConfCacheHeader)))
+        return false;
+    const uchar *map = cache.map(0, cacheSize);
+    if (!map)
+        return false;
+    const uchar *const mapEnd = map + cacheSize;
+
+    ConfCacheHeader header;
+    std::memcpy(&header, map, sizeof(header));
+    const QString absolutePath = info.absoluteFilePath();
+    if (std::memcmp(header.magic, kCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != kCacheVersion ||
+        header.lineSize != sizeof(ConfLine) ||
+        header.fileSize != info.size() ||
+        header.modified != info.lastModified().toMSecsSinceEpoch() ||
+        header.changed != info.metadataChangeTime().toMSecsSinceEpoch() ||
+        header.inode != fileInode(absolutePath) ||
+        header.pathLength != static_cast<quint32>(absolutePath.size()))
+    {
+        return false;
+    }
+
+    const uchar *p = map + sizeof(header);
+    if (mapEnd - p < cacheAligned(header.pathLength * 2) ||
+        std::memcmp(p, absolutePath.utf16(), header.pathLength * 2) != 0)
+    {
+        return false;
+    }
+    p += cacheAligned(header.pathLength * 2);
+
+    const qint64 linesBytes = qint64(header.lineCount) * sizeof(ConfLine);
+    const qint64 entriesBytes = qint64(header.entryCount) * sizeof(quint32);
+    if (mapEnd - p < linesBytes + entriesBytes)
+        return false;
+
+    if (!m_arena.open(path, nullptr) || m_arena.size() != header.fileSize ||
+        sampleHash(m_arena.data(), m_arena.size()) != header.sample)
+    {
+        return false;
+    }
+
+    m_lines.resize(header.lineCount);
+    std::memcpy(m_lines.data(), p, linesBytes);
+    p += linesBytes;
+    for (const ConfLine &line : qAsConst(m_lines))
+    {
+        if (qint64(line.offset) + line.length + line.eolLength > m_arena.size() ||
+            qint64(line.valueBegin) + line.valueLength > line.length || line.keyLength > line.length)
+        {
+            return false;
+        }
+    }
+
+    const uchar *entryData = p;
+    p += entriesBytes;
+
+    for (quint32 i = 1; i < header.sectionCount; ++i)
+    {
+        quint32 length = 0;
+        if (mapEnd - p < 4)
+            return false;
+        std::memcpy(&length, p, 4);
+        p += 4;
+        // A damaged length must neither wrap the size check nor the allocation
+        const qint64 bytes = qint64(length) * 2;
+        if (length > quint32(std::numeric_limits<int>::max() / 2) || mapEnd - p < cacheAligned(bytes))
+            return false;
+        QString section(static_cast<int>(length), Qt::Uninitialized);
+        std::memcpy(section.data(), p, static_cast<size_t>(bytes));
+        p += cacheAligned(bytes);
+        if (m_sections.intern(section) != static_cast<int>(i))
+            return false;
+    }
+
+    m_entries.reserve(header.entryCount);
+    for (quint32 i = 0; i < header.entryCount; ++i)
+    {
+        quint32 lineIndex = 0;
+        std::memcpy(&lineIndex, entryData + i * sizeof(quint32), sizeof(lineIndex));
+        if (lineIndex >= header.lineCount)
+            return false;
+        const ConfLine &line = m_lines[lineIndex];
+        int keyBegin = 0;
+        int keyLength = 0;
+        if (!keySpan(line, &keyBegin, &keyLength))
+            return false;
+
+        ConfigEntry entry;
+        entry.key = textAt(keyBegin, keyLength);
+        entry.section = m_sections.string(line.sectionId);
+        entry.value = textAt(line.offset + line.valueBegin, line.valueLength);
+        entry.lineIndex = static_cast<int>(lineIndex);
+        m_entries.push_back(entry);
+    }
+    return true;
+}
+
+void ConfParser::writeCache(const QString &path, const QString &cachePath) const
+{
+    QFileInfo info(path);
+    const QString absolutePath = info.absoluteFilePath();
+
+    ConfCacheHeader header;
+    std::memcpy(header.magic, kCacheMagic, sizeof(header.magic));
+    header.version = kCacheVersion;
+    header.lineSize = sizeof(ConfLine);
+    header.fileSize = m_arena.size();
+    header.modified = info.lastModified().toMSecsSinceEpoch();
+    header.changed = info.metadataChangeTime().toMSecsSinceEpoch();
+    header.inode = fileInode(absolutePath);
+    header.sample = sampleHash(m_arena.data(), m_arena.size());
+    header.pathLength = absolutePath.size();
+    header.lineCount = m_lines.size();
+    header.entryCount = m_entries.size();
+    header.sectionCount = m_sections.size();
+
+    QByteArray out;
+    out.reserve(sizeof(header) + m_lines.size() * sizeof(ConfLine) + m_entries.size() * sizeof(quint32));
+    auto appendAligned = [&out](const void *data, int size) {
+        out.append(static_cast<const char *>(data), size);
+        out.append(cacheAligned(size) - size, '\0');
+    };
+
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    appendAligned(absolutePath.utf16(), absolutePath.size() * 2);
+    out.append(reinterpret_cast<const char *>(m_lines.constData()), m_lines.size() * sizeof(ConfLine));
+
+    for (const ConfigEntry &entry : m_entries)
+    {
+        const quint32 lineIndex = entry.lineIndex;
+        out.append(reinterpret_cast<const char *>(&lineIndex), sizeof(lineIndex));
+    }
+
+    for (int id = 1; id < m_sections.size(); ++id)
+    {
+        const QString &section = m_sections.string(id);
+        const quint32 length = section.size();
+        out.append(reinterpret_cast<const char *>(&length), 4);
+        appendAligned(section.utf16(), section.size() * 2);
+    }
+
+    // The cache is only an accelerator; failing to write it is not an error
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    if (file.write(out) != out.size())
+        return;
+    file.commit();
+}
+
+void ConfParser::parseBuffer()
+{
+    const char *data = m_arena.data();
+    const int size = m_arena.size();
+
+    // Skip a UTF-8 BOM; it is written back verbatim on save
+    int pos = 0;
+    if (size >= 3 && uchar(data[0]) == 0xEF && uchar(data[1]) == 0xBB && uchar(data[2]) == 0xBF)
+        pos = 3;
+
+    const int threads = QThread::idealThreadCount();
+    const bool parallel = threads > 1 && size - pos >= kMinChunkSize * 2 &&
+        (m_parseMode == ParallelParse || (m_parseMode == AutoParse && size >= kParallelThreshold));
+
+    quint16 currentSection = 0;
+    if (!parallel)
+    {
+        parseRange(pos, size, &m_lines, &m_entries);
+        assignSections(0, 0, &currentSection);
+        return;
+    }
+
+    // Split at line boundaries so every chunk can be classified on its own
+    const int chunkCount = qMin(threads * 4, (size - pos) / kMinChunkSize);
+    const int chunkSize = (size - pos) / chunkCount;
+    QVector<int> bounds;
+    bounds.push_back(pos);
+    for (int i = 1; i < chunkCount; ++i)
+    {
+        int cut = qMax(bounds.last(), pos + i * chunkSize);
+        const char *newline = static_cast<const char *>(std::memchr(data + cut, '\n', size - cut));
+        cut = newline ? static_cast<int>(newline - data) + 1 : size;
+        if (cut > bounds.last() && cut < size)
+            bounds.push_back(cut);
     }
+    bounds.push_back(size);
 
-    QTextStream in(&file);
-    in.setCodec("UTF-8");
-    QString currentSection;
+    const int count = bounds.size() - 1;
+    QVector<QVector<ConfLine>> chunkLines(count);
+    QVector<QVector<ConfigEntry>> chunkEntries(count);
+    QVector<ConfLine> *linesOut = chunkLines.data();
+    QVector<ConfigEntry> *entriesOut = chunkEntries.data();
 
+    QVector<QFuture<void>> futures;
+    futures.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const int begin = bounds[i];
+        const int end = bounds[i + 1];
+        futures.push_back(QtConcurrent::run([this, begin, end, linesOut, entriesOut, i]() {
+            parseRange(begin, end, &linesOut[i], &entriesOut[i]);
+        }));
+    }
+    for (QFuture<void> &future : futures)
+        future.waitForFinished();
+
+    // Sections carry over from chunk to chunk, so they are assigned in order
+    int totalLines = 0;
+    int totalEntries = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        totalLines += chunkLines[i].size();
+        totalEntries += chunkEntries[i].size();
+    }
+    m_lines.reserve(totalLines);
+    m_entries.reserve(totalEntries);
+    for (int i = 0; i < count; ++i)
+    {
+        const int firstLine = m_lines.size();
+        const int firstEntry = m_entries.size();
+        m_lines += chunkLines[i];
+        for (ConfigEntry &entry : chunkEntries[i])
+            m_entries.push_back(std::move(entry));
+        chunkLines[i].clear();
+        chunkEntries[i].clear();
+        assignSections(firstLine, firstEntry, &currentSection);
+    }
+}
+
+// Classifies the lines in [begin, end), appending to lines and entries. Entry
+// line indexes are relative to the range and sections are left for
+// assignSections(), so ranges can be parsed concurrently.
+void ConfParser::parseRange(int begin, int end, QVector<ConfLine> *lines, QVector<ConfigEntry> *entries) const
+{
+    const char *data = m_arena.data();
+    // Lines of the bundled configs average a little over 30 bytes, and about
+    // one in five holds a value
+    const int estimatedLines = (end - begin) / 32 + 1;
+    lines->reserve(lines->size() + estimatedLines);
+    entries->reserve(entries->size() + estimatedLines / 4);
+
+    int pos = begin;
     int lineIndex = 0;
-    while (!in.atEnd())
+    while (pos < end)
     {
-        QString line = in.readLine();
+        const char *newline = static_cast<const char *>(std::memchr(data + pos, '\n', end - pos));
+        const int lineEnd = newline ? static_cast<int>(newline - data) : end;
+        const int next = newline ? lineEnd + 1 : end;
+        int contentEnd = lineEnd;
+        if (contentEnd > pos && data[contentEnd - 1] == '\r')
+            --contentEnd;
+
         ConfLine cl;
-        cl.raw = line;
+        cl.offset = pos;
+        cl.length = contentEnd - pos;
+        cl.eolLength = next - contentEnd;
 
-        QString trimmed = line.trimmed();
-        if (trimmed.isEmpty())
+        const char *line = data + pos;
+        const int length = contentEnd - pos;
+        int first = 0;
+        while (first < length && isSpaceByte(line[first]))
+            ++first;
+
+        int keyBegin = 0;
+        int keyLength = 0;
+        if (first == length)
         {
             cl.type = ConfLine::Blank;
         }
-        else if (trimmed.startsWith('#') || trimmed.startsWith(';'))
+        else if (line[first] == '#' || line[first] == ';')
         {
             cl.type = ConfLine::Comment;
-            QString sectionText;
-            if (isSectionHeader(line, &sectionText))
-                currentSection = sectionText;
+            isSectionHeader(line, length, &cl);
         }
-        else if (parseKeyValueLine(line, &cl))
+        else if (parseKeyValueLine(line, length, &cl, &keyBegin, &keyLength))
         {
             cl.type = ConfLine::KeyValue;
-            cl.section = currentSection;
+            cl.keyLength = keyLength;
 
             ConfigEntry entry;
-            entry.key = cl.key;
-            entry.section = currentSection;
-            entry.value = cl.value;
+            entry.key = textAt(cl.offset + keyBegin, keyLength);
+            entry.value = textAt(cl.offset + cl.valueBegin, cl.valueLength);
             entry.lineIndex = lineIndex;
-            m_entries.push_back(entry);
+            entries->push_back(entry);
         }
         else
         {
             cl.type = ConfLine::Other;
         }
 
-        m_lines.push_back(cl);
+        lines->push_back(cl);
         ++lineIndex;
+        pos = next;
     }
+}
 
+// Fills in the sections of the lines and entries from firstLine and
+// firstEntry on, which parseRange() appended; their entry line indexes are
+// made absolute on the way
+void ConfParser::assignSections(int firstLine, int firstEntry, quint16 *currentSection)
+{
+    for (int i = firstLine; i < m_lines.size(); ++i)
+    {
+        ConfLine &line = m_lines[i];
+        if (line.type == ConfLine::Comment && line.valueLength > 0)
+        {
+            // Ids past the quint16 range are left uncategorized
+            const int id = m_sections.intern(textAt(line.offset + line.valueBegin, line.valueLength).trimmed());
+            *currentSection = id <= 0xFFFF ? static_cast<quint16>(id) : 0;
+            line.sectionId = *currentSection;
+        }
+        else if (line.type == ConfLine::KeyValue)
+        {
+            line.sectionId = *currentSection;
+        }
+    }
+
+    for (int i = firstEntry; i < m_entries.size(); ++i)
+    {
+        ConfigEntry &entry = m_entries[i];
+        entry.lineIndex += firstLine;
+        entry.section = m_sections.string(m_lines[entry.lineIndex].sectionId);
+    }
+}
+
+QString ConfParser::textAt(quint32 offset, quint32 length) const
+{
+    return QString::fromUtf8(m_arena.data() + offset, static_cast<int>(length));
+}
+
+ConfSpan ConfParser::lineSpan(int lineIndex) const
+{
+    ConfSpan span;
+    if (lineIndex < 0 || lineIndex >= m_lines.size())
+        return span;
+    const ConfLine &line = m_lines[lineIndex];
+    span.data = m_arena.data() + line.offset;
+    span.length = static_cast<int>(line.length + line.eolLength);
+    return span;
+}
+
+QString ConfParser::lineText(int lineIndex) const
+{
+    if (lineIndex < 0 || lineIndex >= m_lines.size())
+        return QString();
+    const ConfLine &line = m_lines[lineIndex];
+    return textAt(line.offset, line.length);
+}
+
+QString ConfParser::lineKey(int lineIndex) const
+{
+    if (lineIndex < 0 || lineIndex >= m_lines.size())
+        return QString();
+    const ConfLine &line = m_lines[lineIndex];
+    int keyBegin = 0;
+    int keyLength = 0;
+    if (!keySpan(line, &keyBegin, &keyLength))
+        return QString();
+    return textAt(keyBegin, keyLength);
+}
+
+// Only the indentation before the key is walked; the length was stored by parseRange()
+bool ConfParser::keySpan(const ConfLine &line, int *begin, int *length) const
+{
+    if (line.type != ConfLine::KeyValue)
+        return false;
+    const char *data = m_arena.data();
+    const int end = static_cast<int>(line.offset + line.length);
+    int pos = static_cast<int>(line.offset);
+    while (pos < end && isSpaceByte(data[pos]))
+        ++pos;
+    if (line.keyLength == 0 || end - pos < static_cast<int>(line.keyLength))
+        return false;
+    *begin = pos;
+    *length = static_cast<int>(line.keyLength);
     return true;
 }
 
+QString ConfParser::lineValue(int lineIndex) const
+{
+    if (lineIndex < 0 || lineIndex >= m_lines.size())
+        return QString();
+    const ConfLine &line = m_lines[lineIndex];
+    if (line.type != ConfLine::KeyValue)
+        return QString();
+    if (line.hasNewValue)
+    {
+        const ConfSpan span = m_pendingValues.value(lineIndex);
+        return QString::fromUtf8(span.data, span.length);
+    }
+    return textAt(line.offset + line.valueBegin, line.valueLength);
+}
+
+const QString &ConfParser::lineSection(int lineIndex) const
+{
+    if (lineIndex < 0 || lineIndex >= m_lines.size())
+        return m_sections.string(0);
+    return m_sections.string(m_lines[lineIndex].sectionId);
+}
+
+QString ConfParser::internText(const QString &text)
+{
+    return m_texts.string(m_texts.intern(text));
+}
+
 void ConfParser::setEntryValue(int entryIndex, const QString &value)
 {
     if (entryIndex < 0 || entryIndex >= m_entries.size())
@@ -91,86 +649,198 @@ void ConfParser::setEntryValue(int entryIndex, const QString &value)
         return;
 
     line.hasNewValue = true;
-    line.newValue = value;
+    m_pendingValues.insert(entry.lineIndex, m_arena.store(value.toUtf8()));
 }
 
+// Only lines with a pending value are visited; everything between two edited
+// values is copied from the current buffer in one piece, and offsets are only
+// rebased past edits that change the value length.
 bool ConfParser::save(const QString &path, QString *error)
 {
-    QFile file(path);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    // The file under a mapping may have been rewritten by another program
+    if (!m_arena.mappingIntact())
     {
         if (error)
-            *error = QString("Failed to write config: %1").arg(path);
+            *error = QString("Config changed on disk since it was loaded: %1").arg(m_path);
         return false;
     }
 
-    QTextStream out(&file);
-    out.setCodec("UTF-8");
-    for (const ConfLine &line : m_lines)
+    // m_pendingValues is ordered by line, so the splices come out in file order
+    QVector<QPair<int, ConfSpan>> splices;
+    int growth = 0;
+    for (auto it = m_pendingValues.constBegin(); it != m_pendingValues.constEnd(); ++it)
     {
-        if (line.type == ConfLine::KeyValue && line.hasNewValue && line.newValue != line.value)
+        const ConfLine &line = m_lines[it.key()];
+        const ConfSpan &value = it.value();
+        if (value.length == static_cast<int>(line.valueLength) &&
+            std::memcmp(value.data, m_arena.data() + line.offset + line.valueBegin, line.valueLength) == 0)
         {
-            out << line.prefix << line.newValue << line.valueTrailingSpace << line.suffix << "\n";
+            continue;
         }
-        else
+        splices.push_back(qMakePair(it.key(), value));
+        growth += value.length - static_cast<int>(line.valueLength);
+    }
+
+    const QString absolutePath = QFileInfo(path).absoluteFilePath();
+    if (splices.isEmpty() && absolutePath == m_path)
+    {
+        for (auto it = m_pendingValues.constBegin(); it != m_pendingValues.constEnd(); ++it)
+            m_lines[it.key()].hasNewValue = false;
+        m_pendingValues.clear();
+        return true;
+    }
+
+#if defined(Q_OS_WIN)
+    // Windows cannot replace a file that is still mapped
+    m_arena.releaseMapping();
+#endif
+
+    const char *data = m_arena.data();
+    const int size = m_arena.size();
+
+    QByteArray out;
+    if (splices.isEmpty())
+    {
+        out = QByteArray::fromRawData(data, size);
+    }
+    else
+    {
+        out.reserve(size + growth);
+        int copied = 0;
+        for (const auto &splice : qAsConst(splices))
         {
-            out << line.raw << "\n";
+            const ConfLine &line = m_lines[splice.first];
+            const int valueBegin = static_cast<int>(line.offset + line.valueBegin);
+            out.append(data + copied, valueBegin - copied);
+            out.append(splice.second.data, splice.second.length);
+            copied = valueBegin + static_cast<int>(line.valueLength);
         }
+        out.append(data + copied, size - copied);
     }
+
+    if (!writeFileAtomically(path, out, error))
+        return false;
+
+    int shift = 0;
+    int from = 0;
+    for (const auto &splice : qAsConst(splices))
+    {
+        if (shift != 0)
+        {
+            for (int i = from; i <= splice.first; ++i)
+                m_lines[i].offset += shift;
+        }
+        ConfLine &line = m_lines[splice.first];
+        const int change = splice.second.length - static_cast<int>(line.valueLength);
+        line.length += change;
+        line.valueLength = splice.second.length;
+        shift += change;
+        from = splice.first + 1;
+    }
+    if (shift != 0)
+    {
+        for (int i = from; i < m_lines.size(); ++i)
+            m_lines[i].offset += shift;
+    }
+
+    for (auto it = m_pendingValues.constBegin(); it != m_pendingValues.constEnd(); ++it)
+        m_lines[it.key()].hasNewValue = false;
+    m_pendingValues.clear();
+
+    // The written bytes become the new buffer so the line offsets stay valid;
+    // this also frees the arena blocks that held the pending values
+    if (!splices.isEmpty())
+        m_arena.adopt(out);
+    else if (absolutePath != m_path)
+        m_arena.releaseMapping();   // Saved as another file; stop holding the old one
+    m_path = absolutePath;
+
+    const QString cachePath = cachePathFor(path);
+    if (!cachePath.isEmpty())
+        writeCache(path, cachePath);
     return true;
 }
 
-bool ConfParser::isSectionHeader(const QString &line, QString *sectionOut) const
+bool ConfParser::isSectionHeader(const char *line, int length, ConfLine *out) const
 {
-    QString text = trimCommentPrefix(line).trimmed();
-    if (text.isEmpty())
-        return false;
-
-    if (text.contains(':'))
+    int begin = 0;
+    while (begin < length && isSpaceByte(line[begin]))
+        ++begin;
+    if (begin < length && line[begin] == '#')
+        ++begin;
+    while (begin < length && isSpaceByte(line[begin]))
+        ++begin;
+    int end = length;
+    while (end > begin && isSpaceByte(line[end - 1]))
+        --end;
+    if (begin == end)
         return false;
 
     bool hasLetter = false;
-    bool allUpper = true;
-    for (QChar ch : text)
+    bool ascii = true;
+    for (int i = begin; i < end && ascii; ++i)
     {
-        if (ch.isLetter())
-        {
+        const uchar ch = uchar(line[i]);
+        if (ch >= 0x80)
+            ascii = false;
+        else if (ch == ':')
+            return false;
+        else if (ch >= 'a' && ch <= 'z')
+            return false;
+        else if (ch >= 'A' && ch <= 'Z')
             hasLetter = true;
-            if (ch.toUpper() != ch)
-                allUpper = false;
-        }
     }
 
-    if (!hasLetter || !allUpper)
-        return false;
-
-    if (text.size() < 3 || text.size() > 80)
+    if (ascii)
+    {
+        if (!hasLetter)
+            return false;
+        if (end - begin < 3 || end - begin > 80)
+            return false;
+    }
+    else if (!isSectionHeaderText(QString::fromUtf8(line, length)))
+    {
         return false;
+    }
 
-    if (sectionOut)
-        *sectionOut = text;
+    if (out)
+    {
+        out->valueBegin = begin;
+        out->valueLength = end - begin;
+    }
     return true;
 }
 
-bool ConfParser::parseKeyValueLine(const QString &line, ConfLine *out) const
+// Positions are relative to line; the key span is returned for the caller
+// to build the key from
+bool ConfParser::parseKeyValueLine(const char *line, int length, ConfLine *out, int *keyBegin, int *keyLength) const
 {
-    int eq = line.indexOf('=');
-    if (eq < 0)
+    const char *eqPtr = static_cast<const char *>(std::memchr(line, '=', length));
+    if (!eqPtr)
         return false;
+    const int eq = static_cast<int>(eqPtr - line);
 
-    QString left = line.left(eq).trimmed();
-    if (left.isEmpty())
+    int begin = 0;
+    while (begin < eq && isSpaceByte(line[begin]))
+        ++begin;
+    int keyEnd = eq;
+    while (keyEnd > begin && isSpaceByte(line[keyEnd - 1]))
+        --keyEnd;
+    if (keyEnd == begin)
         return false;
 
+    *keyBegin = begin;
+    *keyLength = keyEnd - begin;
+
     int valueStart = eq + 1;
-    while (valueStart < line.size() && line[valueStart].isSpace())
+    while (valueStart < length && isSpaceByte(line[valueStart]))
         ++valueStart;
 
     bool inQuotes = false;
     int commentPos = -1;
-    for (int i = valueStart; i < line.size(); ++i)
+    for (int i = valueStart; i < length; ++i)
     {
-        QChar ch = line[i];
+        const char ch = line[i];
         if (ch == '"' && (i == 0 || line[i - 1] != '\\'))
             inQuotes = !inQuotes;
         if (ch == '#' && !inQuotes)
@@ -180,22 +850,12 @@ bool ConfParser::parseKeyValueLine(const QString &line, ConfLine *out) const
         }
     }
 
-    int valueEnd = (commentPos == -1) ? line.size() : commentPos;
-    QString valueRaw = line.mid(valueStart, valueEnd - valueStart);
-
-    int trimEnd = valueRaw.size();
-    while (trimEnd > 0 && valueRaw[trimEnd - 1].isSpace())
+    const int valueEnd = (commentPos == -1) ? length : commentPos;
+    int trimEnd = valueEnd;
+    while (trimEnd > valueStart && isSpaceByte(line[trimEnd - 1]))
         --trimEnd;
-    QString valueTrailingSpace = valueRaw.mid(trimEnd);
-
-    if (out)
-    {
-        out->key = left;
-        out->value = valueRaw.trimmed();
-        out->prefix = line.left(valueStart);
-        out->suffix = line.mid(valueEnd);
-        out->valueTrailingSpace = valueTrailingSpace;
-    }
 
+    out->valueBegin = valueStart;
+    out->valueLength = trimEnd - valueStart;
     return true;
 }
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <QMap>
 #include <QString>
 #include <QVector>
 #include <QHash>
 
+#include "confstorage.h"
+
+// A line is stored as offsets into the file buffer owned by the parser's
+// arena. Strings are only built on demand through the ConfParser accessors.
 struct ConfLine
 {
-    enum Type
+    enum Type : quint8
     {
         Blank,
         Comment,
@@ -14,16 +19,15 @@ struct ConfLine
         Other
     };
 
+    quint32 offset = 0;       // Start of the line in the buffer
+    quint32 length = 0;       // Line length without the line terminator
+    quint32 valueBegin = 0;   // KeyValue: trimmed value span; Comment: section header text
+    quint32 valueLength = 0;  // (both relative to offset)
+    quint32 keyLength = 0;    // KeyValue: the key starts at the first non-space byte
+    quint16 sectionId = 0;    // Id in ConfParser::sections(), 0 when there is none
     Type type = Other;
-    QString raw;
-    QString key;
-    QString value;
-    QString prefix;
-    QString suffix;
-    QString valueTrailingSpace;
-    QString section;
-    bool hasNewValue = false;
-    QString newValue;
+    quint8 eolLength = 0;     // Length of the line terminator ("\n" or "\r\n")
+    bool hasNewValue = false; // New value is kept by the parser until save
 };
 
 struct ConfigEntry
@@ -36,24 +40,84 @@ struct ConfigEntry
     int lineIndex = -1;
 };
 
+// A key that is defined on more than one line
+struct ConfDuplicateKey
+{
+    QString key;
+    QVector<int> lineNumbers;   // 1-based, in file order; the last one takes effect
+};
+
 class ConfParser
 {
 public:
+    enum ParseMode
+    {
+        AutoParse,      // Parallel only for large files
+        SerialParse,
+        ParallelParse
+    };
+
+    ConfParser();
+    ~ConfParser();
+
+    void setParseMode(ParseMode mode) { m_parseMode = mode; }
+    ParseMode parseMode() const { return m_parseMode; }
+
+    // When set, load() reuses a binary snapshot (.confcache) of the parsed
+    // file as long as the file is unchanged, and save() refreshes it
+    void setCacheDirectory(const QString &dir) { m_cacheDir = dir; }
+
     bool load(const QString &path, QString *error);
     bool save(const QString &path, QString *error);
 
     const QVector<ConfLine> &lines() const { return m_lines; }
-    QVector<ConfLine> &lines() { return m_lines; }
+
+    // Raw bytes of a line including its terminator, as loaded or last saved;
+    // valid until the next load() or save()
+    ConfSpan lineSpan(int lineIndex) const;
+    QString lineText(int lineIndex) const;
+    QString lineKey(int lineIndex) const;
+    QString lineValue(int lineIndex) const;
+    const QString &lineSection(int lineIndex) const;
+
+    const ConfStringPool &sections() const { return m_sections; }
+    QString internText(const QString &text);
 
     const QVector<ConfigEntry> &entries() const { return m_entries; }
     QVector<ConfigEntry> &entries() { return m_entries; }
 
     void setEntryValue(int entryIndex, const QString &value);
 
+    // Like the server, a key defined more than once resolves to its last
+    // occurrence. Edits only touch values, so the index built on load stays valid.
+    int entryIndex(const QString &key) const { return m_keyIndex.value(key, -1); }
+    const ConfigEntry *findEntry(const QString &key) const;
+    QVector<ConfDuplicateKey> duplicateKeys() const;
+
 private:
-    bool isSectionHeader(const QString &line, QString *sectionOut) const;
-    bool parseKeyValueLine(const QString &line, ConfLine *out) const;
+    Q_DISABLE_COPY(ConfParser)
+
+    void clear();
+    QString cachePathFor(const QString &path) const;
+    bool loadCache(const QString &path, const QString &cachePath);
+    void writeCache(const QString &path, const QString &cachePath) const;
+    void parseBuffer();
+    void buildKeyIndex();
+    void parseRange(int begin, int end, QVector<ConfLine> *lines, QVector<ConfigEntry> *entries) const;
+    void assignSections(int firstLine, int firstEntry, quint16 *currentSection);
+    QString textAt(quint32 offset, quint32 length) const;
+    bool isSectionHeader(const char *line, int length, ConfLine *out) const;
+    bool parseKeyValueLine(const char *line, int length, ConfLine *out, int *keyBegin, int *keyLength) const;
+    bool keySpan(const ConfLine &line, int *begin, int *length) const;
 
+    ParseMode m_parseMode = AutoParse;
+    QString m_cacheDir;
+    QString m_path;           // Absolute path of the loaded file
+    ConfArena m_arena;
+    ConfStringPool m_sections;
+    ConfStringPool m_texts;
     QVector<ConfLine> m_lines;
     QVector<ConfigEntry> m_entries;
+    QHash<QString, int> m_keyIndex;
+    QMap<int, ConfSpan> m_pendingValues;
 };
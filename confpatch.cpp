@@ -0,0 +1,134 @@
+#include "confpatch.h"
+#include "confparser.h"
+
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+
+bool ConfPatch::load(const QString &path, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        if (error)
+            *error = QString("Failed to open patch: %1").arg(path);
+        return false;
+    }
+    return parse(file.readAll(), error);
+}
+
+bool ConfPatch::parse(const QByteArray &data, QString *error)
+{
+    m_items.clear();
+
+    int i = 0;
+    if (data.startsWith("\xEF\xBB\xBF"))
+        i = 3;
+    while (i < data.size() && QChar::isSpace(uchar(data[i])))
+        ++i;
+
+    if (i < data.size() && data[i] == '{')
+        return parseJson(data, error);
+    return parseText(data, error);
+}
+
+bool ConfPatch::parseJson(const QByteArray &data, QString *error)
+{
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+    {
+        if (error)
+            *error = QString("Invalid JSON patch: %1").arg(parseError.errorString());
+        return false;
+    }
+
+    const QJsonObject object = doc.object();
+    m_items.reserve(object.size());
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it)
+    {
+        ConfPatchItem item;
+        item.key = it.key().trimmed();
+        switch (it.value().type())
+        {
+        case QJsonValue::Bool:
+            // Config switches are 0/1
+            item.value = it.value().toBool() ? "1" : "0";
+            break;
+        case QJsonValue::Double:
+        case QJsonValue::String:
+            item.value = it.value().toVariant().toString();
+            break;
+        default:
+            if (error)
+                *error = QString("Unsupported value for key %1 in JSON patch").arg(it.key());
+            return false;
+        }
+        m_items.push_back(item);
+    }
+    return true;
+}
+
+bool ConfPatch::parseText(const QByteArray &data, QString *error)
+{
+    const int bom = data.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+    const QString text = QString::fromUtf8(data.constData() + bom, data.size() - bom);
+    int lineNumber = 0;
+    for (const QStringRef &rawLine : text.splitRef('\n'))
+    {
+        ++lineNumber;
+        const QStringRef line = rawLine.trimmed();
+        if (line.isEmpty() || line.startsWith('#') || line.startsWith(';'))
+            continue;
+
+        const int eq = line.indexOf('=');
+        const QString key = eq > 0 ? line.left(eq).trimmed().toString() : QString();
+        if (key.isEmpty())
+        {
+            if (error)
+                *error = QString("Invalid patch line %1: %2").arg(lineNumber).arg(line.toString());
+            return false;
+        }
+
+        ConfPatchItem item;
+        item.key = key;
+        item.value = line.mid(eq + 1).trimmed().toString();
+        m_items.push_back(item);
+    }
+    return true;
+}
+
+ConfPatchResult ConfPatch::apply(ConfParser *parser) const
+{
+    ConfPatchResult result;
+
+    // The last item for a key wins, as in the config itself
+    QHash<QString, int> lastItem;
+    lastItem.reserve(m_items.size());
+    for (int i = 0; i < m_items.size(); ++i)
+        lastItem.insert(m_items[i].key, i);
+
+    for (int i = 0; i < m_items.size(); ++i)
+    {
+        const ConfPatchItem &item = m_items[i];
+        if (lastItem.value(item.key) != i)
+            continue;
+
+        const int entryIndex = parser->entryIndex(item.key);
+        if (entryIndex < 0)
+        {
+            result.unknownKeys << item.key;
+            continue;
+        }
+        if (parser->entries()[entryIndex].value == item.value)
+        {
+            result.unchangedKeys << item.key;
+            continue;
+        }
+        parser->setEntryValue(entryIndex, item.value);
+        result.changedEntries << entryIndex;
+    }
+    return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class ConfParser;
+
+struct ConfPatchItem
+{
+    QString key;
+    QString value;
+};
+
+struct ConfPatchResult
+{
+    QVector<int> changedEntries;   // Entry indexes in the parser
+    QStringList unchangedKeys;     // Already had the requested value
+    QStringList unknownKeys;       // Not defined in the config
+};
+
+// A list of key/value changes read from a "key = value" text file or a flat
+// JSON object. Later items override earlier ones for the same key.
+class ConfPatch
+{
+public:
+    bool load(const QString &path, QString *error);
+    bool parse(const QByteArray &data, QString *error);
+
+    const QVector<ConfPatchItem> &items() const { return m_items; }
+
+    // Resolves every key through the parser's key index and stages all values
+    // in one pass; nothing is written until the parser is saved
+    ConfPatchResult apply(ConfParser *parser) const;
+
+private:
+    bool parseJson(const QByteArray &data, QString *error);
+    bool parseText(const QByteArray &data, QString *error);
+
+    QVector<ConfPatchItem> m_items;
+};
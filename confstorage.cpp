@@ -0,0 +1,206 @@
+#include "confstorage.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <cstring>
+#include <limits>
+
+#if !defined(Q_OS_WIN)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const int kArenaBlockSize = 4096;
+// Smaller files are copied: that is cheap, and an owned buffer cannot fault
+// when the file is truncated or rewritten in place while it is being edited
+static const qint64 kMinMappedSize = 1024 * 1024;
+
+ConfStringPool::ConfStringPool()
+{
+    clear();
+}
+
+int ConfStringPool::intern(const QString &text)
+{
+    if (text.isEmpty())
+        return 0;
+
+    auto it = m_ids.constFind(text);
+    if (it != m_ids.constEnd())
+        return it.value();
+
+    const int id = m_strings.size();
+    m_strings.push_back(text);
+    m_ids.insert(text, id);
+    return id;
+}
+
+const QString &ConfStringPool::string(int id) const
+{
+    if (id <= 0 || id >= m_strings.size())
+        return m_strings.first();
+    return m_strings[id];
+}
+
+void ConfStringPool::clear()
+{
+    m_strings.clear();
+    m_ids.clear();
+    m_strings.push_back(QString());
+}
+
+ConfArena::ConfArena() = default;
+
+ConfArena::~ConfArena()
+{
+    reset();
+}
+
+bool ConfArena::open(const QString &path, QString *error)
+{
+    reset();
+
+    QScopedPointer<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        if (error)
+            *error = QString("Failed to open config: %1").arg(path);
+        return false;
+    }
+
+    const qint64 size = file->size();
+    if (size > std::numeric_limits<int>::max())
+    {
+        if (error)
+            *error = QString("Config file is too large: %1").arg(path);
+        return false;
+    }
+
+    if (size > 0)
+    {
+        uchar *map = size >= kMinMappedSize ? file->map(0, size) : nullptr;
+        if (map)
+        {
+            m_map = map;
+            m_mappedModified = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+            m_buffer = QByteArray::fromRawData(reinterpret_cast<const char *>(map), static_cast<int>(size));
+            m_file.reset(file.take());
+        }
+        else
+        {
+            // Small, or on a file system that cannot be mapped: a single read
+            m_buffer = file->readAll();
+        }
+    }
+    return true;
+}
+
+void ConfArena::adopt(const QByteArray &data)
+{
+    reset();
+    m_buffer = data;
+}
+
+bool ConfArena::mappingIntact() const
+{
+    if (!m_map)
+        return true;
+    const QFileInfo info(m_file->fileName());
+    return info.exists() && info.size() == m_buffer.size() &&
+           info.lastModified().toMSecsSinceEpoch() == m_mappedModified;
+}
+
+void ConfArena::releaseMapping()
+{
+    if (!m_map)
+        return;
+
+    // Keep an owned copy so the file can be rewritten while we still hold its contents
+    QByteArray owned(m_buffer.constData(), m_buffer.size());
+    m_buffer = owned;
+    m_file->unmap(m_map);
+    m_file->close();
+    m_file.reset();
+    m_map = nullptr;
+}
+
+void ConfArena::reset()
+{
+    m_buffer.clear();
+    if (m_file)
+    {
+        if (m_map)
+            m_file->unmap(m_map);
+        m_file->close();
+        m_file.reset();
+    }
+    m_map = nullptr;
+    m_mappedModified = 0;
+    m_blocks.clear();
+    m_blockUsed = 0;
+}
+
+ConfSpan ConfArena::store(const QByteArray &bytes)
+{
+    ConfSpan span;
+    span.length = bytes.size();
+    if (bytes.isEmpty())
+        return span;
+
+    if (m_blocks.isEmpty() || m_blocks.last().size() - m_blockUsed < bytes.size())
+    {
+        m_blocks.push_back(QByteArray(qMax(kArenaBlockSize, bytes.size()), Qt::Uninitialized));
+        m_blockUsed = 0;
+    }
+
+    // Blocks never grow, so pointers into them stay valid until reset()
+    char *dest = m_blocks.last().data() + m_blockUsed;
+    std::memcpy(dest, bytes.constData(), bytes.size());
+    m_blockUsed += bytes.size();
+    span.data = dest;
+    return span;
+}
+
+qint64 ConfArena::bytesAllocated() const
+{
+    qint64 total = m_map ? 0 : m_buffer.capacity();
+    for (const QByteArray &block : m_blocks)
+        total += block.size();
+    return total;
+}
+
+bool writeFileAtomically(const QString &path, const QByteArray &data, QString *error)
+{
+    auto fail = [&]() {
+        if (error)
+            *error = QString("Failed to write config: %1").arg(path);
+        return false;
+    };
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return fail();
+
+    if (file.write(data) != data.size() || !file.flush())
+    {
+        file.cancelWriting();
+        return fail();
+    }
+
+    // commit() syncs the temporary file to disk before renaming it
+    if (!file.commit())
+        return fail();
+
+#if !defined(Q_OS_WIN)
+    // Make the rename itself durable
+    const int dir = ::open(QFile::encodeName(QFileInfo(path).absolutePath()).constData(), O_RDONLY);
+    if (dir >= 0)
+    {
+        ::fsync(dir);
+        ::close(dir);
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QScopedPointer>
+#include <QString>
+#include <QVector>
+
+class QFile;
+
+// A byte range owned by a ConfArena.
+struct ConfSpan
+{
+    const char *data = nullptr;
+    int length = 0;
+};
+
+// Interns repeated strings and hands out small integer ids.
+// Id 0 is always the empty string.
+class ConfStringPool
+{
+public:
+    ConfStringPool();
+
+    int intern(const QString &text);
+    const QString &string(int id) const;
+    int size() const { return m_strings.size(); }
+    void clear();
+
+private:
+    QVector<QString> m_strings;
+    QHash<QString, int> m_ids;
+};
+
+// Owns all storage of one loaded file: the file buffer (mapped when the file
+// is large, read into memory otherwise) and a bump allocator for bytes
+// produced while editing. reset() frees everything at once.
+class ConfArena
+{
+public:
+    ConfArena();
+    ~ConfArena();
+
+    bool open(const QString &path, QString *error);
+    void adopt(const QByteArray &data);
+    void releaseMapping();
+    void reset();
+
+    const char *data() const { return m_buffer.constData(); }
+    int size() const { return m_buffer.size(); }
+    bool isMapped() const { return m_map != nullptr; }
+    // False when the mapped file has changed size or modification time since
+    // open(); touching the mapping of a truncated file would fault
+    bool mappingIntact() const;
+
+    ConfSpan store(const QByteArray &bytes);
+    qint64 bytesAllocated() const;
+
+private:
+    Q_DISABLE_COPY(ConfArena)
+
+    QScopedPointer<QFile> m_file;
+    uchar *m_map = nullptr;
+    qint64 m_mappedModified = 0;   // Modification time of the mapped file, ms since epoch
+    QByteArray m_buffer;
+    QVector<QByteArray> m_blocks;
+    int m_blockUsed = 0;
+};
+
+// Replaces the file at path with data: the bytes go to a temporary file in the
+// same directory, are flushed to disk and then renamed over the original, so
+// a crash leaves either the old or the new file, never a partial one.
+bool writeFileAtomically(const QString &path, const QByteArray &data, QString *error);
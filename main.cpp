@@ -1,10 +1,19 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include <QIcon>
 #include <QScreen>
+#include "confcli.h"
 #include "mainwindow.h"
 
 int main(int argc, char *argv[])
 {
+    // Scripted get/set/diff run without a display or any widgets
+    if (ConfCli::isRequested(argc, argv))
+    {
+        QCoreApplication app(argc, argv);
+        return ConfCli::run(app.arguments());
+    }
+
     // Enable high DPI scaling
     QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
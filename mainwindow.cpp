@@ -1,10 +1,13 @@
 #include "mainwindow.h"
 #include "editentrydialog.h"
+#include "confdiffdialog.h"
+#include "confpatch.h"
 
 #include <QApplication>
 #include <QCloseEvent>
 #include <QComboBox>
 #include <QDir>
+#include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QFrame>
@@ -20,7 +23,9 @@
 #include <QPushButton>
 #include <QScreen>
 #include <QSet>
+#include <QThread>
 #include <QSettings>
+#include <QStandardPaths>
 #include <QTableView>
 #include <QTimer>
 #include <QVBoxLayout>
@@ -28,11 +33,20 @@
 #include <QtConcurrent>
 
 namespace {
+// The future keeps its own copy of the result, so the store travels behind a
+// pointer and is moved out on the GUI thread
 struct TranslationLoadResult
 {
-    TranslationStore store;
+    QSharedPointer<TranslationStore> store;
     QString error;
     QString path;
+    QString migrationSource;   // YAML file to write into path in the background
+    bool ok = false;
+};
+
+struct TranslationMigrationResult
+{
+    QString error;
     bool ok = false;
 };
 }
@@ -43,6 +57,8 @@ MainWindow::MainWindow(QWidget *parent)
     setWindowTitle("WY配置编辑器");
     setWindowFlags(Qt::FramelessWindowHint);
     setAttribute(Qt::WA_TranslucentBackground);
+    m_parser.setCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    m_migrationPool.setMaxThreadCount(1);
     buildUi();
     applyGlobalStyles();
     QTimer::singleShot(0, this, [this]() {
@@ -107,6 +123,11 @@ void MainWindow::buildUi()
     m_versionCombo->setCursor(Qt::PointingHandCursor);
     topBarLayout->addWidget(m_versionCombo);
 
+    m_migrationLabel = new QLabel(this);
+    m_migrationLabel->setObjectName("MigrationLabel");
+    m_migrationLabel->hide();
+    topBarLayout->addWidget(m_migrationLabel);
+
     topBarLayout->addSpacing(12);
 
     QLabel *adLabel = new QLabel("WY技术交流群:738942437", this);
@@ -170,11 +191,28 @@ void MainWindow::buildUi()
     m_searchEdit->setPlaceholderText("搜索配置项...");
     toolbarLayout->addWidget(m_searchEdit, 1);
 
+    m_fuzzyButton = new QPushButton("模糊", this);
+    m_fuzzyButton->setObjectName("GhostButton");
+    m_fuzzyButton->setCursor(Qt::PointingHandCursor);
+    m_fuzzyButton->setCheckable(true);
+    m_fuzzyButton->setToolTip("按字符顺序模糊匹配键名和名称（如 mapupthr 匹配 MapUpdate.Threads），结果按匹配度排序");
+    toolbarLayout->addWidget(m_fuzzyButton);
+
     QPushButton *openButton = new QPushButton("打开配置", this);
     openButton->setObjectName("GhostButton");
     openButton->setCursor(Qt::PointingHandCursor);
     toolbarLayout->addWidget(openButton);
 
+    QPushButton *compareButton = new QPushButton("对比", this);
+    compareButton->setObjectName("GhostButton");
+    compareButton->setCursor(Qt::PointingHandCursor);
+    toolbarLayout->addWidget(compareButton);
+
+    QPushButton *patchButton = new QPushButton("批量修改", this);
+    patchButton->setObjectName("GhostButton");
+    patchButton->setCursor(Qt::PointingHandCursor);
+    toolbarLayout->addWidget(patchButton);
+
     QPushButton *saveButton = new QPushButton("保存", this);
     saveButton->setObjectName("PrimaryButton");
     saveButton->setCursor(Qt::PointingHandCursor);
@@ -224,6 +262,10 @@ void MainWindow::buildUi()
     m_proxy->setSourceModel(m_model);
     m_table->setModel(m_proxy);
 
+    const bool fuzzySearch = QSettings("WY", "ConfEdit").value("fuzzySearch", false).toBool();
+    m_fuzzyButton->setChecked(fuzzySearch);
+    m_proxy->setFuzzy(fuzzySearch);
+
     // Calculate column widths based on window width
     int tableWidth = windowWidth - 250; // Subtract left panel and margins
     m_table->horizontalHeader()->resizeSection(0, static_cast<int>(tableWidth * 0.35));
@@ -232,6 +274,8 @@ void MainWindow::buildUi()
 
     connect(m_searchEdit, &QLineEdit::textChanged,
             this, &MainWindow::onSearchChanged);
+    connect(m_fuzzyButton, &QPushButton::toggled,
+            this, &MainWindow::onFuzzySearchToggled);
     connect(m_sectionList, &QListWidget::currentItemChanged,
             this, &MainWindow::onSectionChanged);
     connect(m_versionCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
@@ -240,6 +284,10 @@ void MainWindow::buildUi()
             this, &MainWindow::onTableDoubleClicked);
     connect(openButton, &QPushButton::clicked,
             this, &MainWindow::onOpenConfig);
+    connect(compareButton, &QPushButton::clicked,
+            this, &MainWindow::onCompareConfig);
+    connect(patchButton, &QPushButton::clicked,
+            this, &MainWindow::onApplyPatch);
     connect(saveButton, &QPushButton::clicked,
             this, &MainWindow::onSaveAll);
     connect(minButton, &QPushButton::clicked,
@@ -274,6 +322,11 @@ void MainWindow::applyGlobalStyles()
             font-size: 13px;
             margin-left: 12px;
         }
+        QLabel#MigrationLabel {
+            color: rgba(80, 60, 80, 0.5);
+            font-size: 13px;
+            margin-left: 8px;
+        }
         QLabel#VersionLabel {
             color: rgba(80, 60, 80, 0.7);
             font-size: 13px;
@@ -410,6 +463,10 @@ void MainWindow::applyGlobalStyles()
             background-color: rgba(255, 255, 255, 0.35);
             border-color: rgba(210, 153, 194, 0.7);
         }
+        QPushButton#GhostButton:checked {
+            background-color: rgba(210, 153, 194, 0.25);
+            border-color: rgba(210, 153, 194, 0.9);
+        }
         QTableView {
             background-color: rgba(255, 255, 255, 0.4);
             alternate-background-color: rgba(255, 255, 255, 0.3);
@@ -498,6 +555,14 @@ void MainWindow::applyGlobalStyles()
         QScrollBar::sub-line:horizontal {
             width: 0px;
         }
+        QDialog#DiffDialog {
+            background: qlineargradient(x1:0, y1:0, x2:1, y2:1,
+                stop:0 #d4f5f3, stop:0.4 #fff8fa, stop:0.7 #faf5f8, stop:1 #fffafb);
+        }
+        QDialog#DiffDialog QLabel {
+            color: rgba(80, 60, 80, 0.7);
+            font-size: 14px;
+        }
         QDialog#EditEntryDialog {
             background: qlineargradient(x1:0, y1:0, x2:1, y2:1,
                 stop:0 #d4f5f3, stop:0.4 #fff8fa, stop:0.7 #faf5f8, stop:1 #fffafb);
@@ -581,7 +646,10 @@ void MainWindow::applyGlobalStyles()
 void MainWindow::loadDefaultFiles()
 {
     QString base = QDir::currentPath();
-    m_translationPath = QDir(base).filePath("translation.db");
+    // A binary pack converted from translation.db opens without parsing
+    m_translationPath = QDir(base).filePath("translation.wypack");
+    if (!QFileInfo::exists(m_translationPath))
+        m_translationPath = QDir(base).filePath("translation.db");
 
     // Load translation file asynchronously to avoid blocking UI
     loadTranslationAsync(m_translationPath);
@@ -599,9 +667,38 @@ void MainWindow::loadConfig(const QString &path)
     m_configDirty = false;
     m_model->setEntries(&m_parser.entries());
     saveLastOpenedFile();
+    reportDuplicateKeys();
     updateFilePathLabel();
 }
 
+// Stock configs often repeat a key, so this is only noted next to the file
+// name (details in its tooltip) instead of interrupting every load
+void MainWindow::reportDuplicateKeys()
+{
+    m_duplicateKeyCount = 0;
+    m_duplicateKeyReport.clear();
+    const QVector<ConfDuplicateKey> duplicates = m_parser.duplicateKeys();
+    if (duplicates.isEmpty())
+        return;
+
+    const int maxShown = 20;
+    QStringList lines;
+    for (int i = 0; i < duplicates.size() && i < maxShown; ++i)
+    {
+        const ConfDuplicateKey &duplicate = duplicates[i];
+        QStringList numbers;
+        for (int number : duplicate.lineNumbers)
+            numbers << QString::number(number);
+        lines << QString("%1：第 %2 行（生效：第 %3 行）")
+                     .arg(duplicate.key, numbers.join(", "), numbers.last());
+    }
+    if (duplicates.size() > maxShown)
+        lines << QString("……另有 %1 个重复键").arg(duplicates.size() - maxShown);
+
+    m_duplicateKeyCount = duplicates.size();
+    m_duplicateKeyReport = QString("以下配置键定义了多次，只有最后一处生效：\n%1").arg(lines.join("\n"));
+}
+
 void MainWindow::loadTranslation(const QString &path)
 {
     QString error;
@@ -626,8 +723,10 @@ void MainWindow::loadTranslation(const QString &path)
             m_versionCombo->addItem(ver, ver);
         if (!selected.isEmpty())
         {
-            m_translations.setCurrentVersion(selected);
-            int index = m_versionCombo->findData(selected);
+            QString versionError;
+            if (!m_translations.setCurrentVersion(selected, &versionError))
+                QMessageBox::warning(this, "切换翻译版本", versionError);
+            int index = m_versionCombo->findData(m_translations.currentVersion());
             if (index >= 0)
                 m_versionCombo->setCurrentIndex(index);
         }
@@ -656,7 +755,7 @@ void MainWindow::loadTranslationAsync(const QString &path)
             return;
         }
 
-        m_translations = result.store;
+        m_translations = std::move(*result.store);
         m_translationPath = result.path;
         m_translationDirty = false;
 
@@ -673,14 +772,19 @@ void MainWindow::loadTranslationAsync(const QString &path)
                 m_versionCombo->addItem(ver, ver);
             if (!selected.isEmpty())
             {
-                m_translations.setCurrentVersion(selected);
-                int index = m_versionCombo->findData(selected);
+                QString versionError;
+                if (!m_translations.setCurrentVersion(selected, &versionError))
+                    QMessageBox::warning(this, "切换翻译版本", versionError);
+                int index = m_versionCombo->findData(m_translations.currentVersion());
                 if (index >= 0)
                     m_versionCombo->setCurrentIndex(index);
             }
             m_versionCombo->blockSignals(false);
         }
 
+        if (!result.migrationSource.isEmpty())
+            startTranslationMigration(result.migrationSource, result.path);
+
         // Try to load last opened config file
         QString lastFile = loadLastOpenedFile();
         if (!lastFile.isEmpty() && QFileInfo::exists(lastFile))
@@ -692,75 +796,126 @@ void MainWindow::loadTranslationAsync(const QString &path)
         }
     });
 
-    QFuture<TranslationLoadResult> future = QtConcurrent::run([path]() {
+    // Only the version the UI will show is read up front
+    const QString preferredVersion = QSettings("WY", "ConfEdit").value("translationVersion").toString();
+    QFuture<TranslationLoadResult> future = QtConcurrent::run([path, preferredVersion]() {
         TranslationLoadResult result;
         result.path = path;
         QString error;
-        TranslationStore store;
+        QSharedPointer<TranslationStore> store(new TranslationStore());
         QFileInfo info(path);
         QString lower = path.toLower();
         bool isSqlite = lower.endsWith(".db") || lower.endsWith(".sqlite") || lower.endsWith(".sqlite3");
-        if (info.exists())
+
+        // translation.db is built from translation.yaml when it is missing, and
+        // rebuilt when it still mirrors an older YAML: the stored source hash
+        // differs from the current one. Saving from the editor clears that hash,
+        // so a database holding the user's edits is never rebuilt.
+        QString yamlPath = QDir(info.absolutePath()).filePath("translation.yaml");
+        bool migrate = false;
+        if (isSqlite && QFileInfo::exists(yamlPath))
         {
-            if (store.load(path, &error))
+            if (!info.exists())
             {
-                result.ok = true;
-                result.store = store;
+                migrate = true;
             }
             else
             {
-                result.ok = false;
-                result.error = error;
-            }
-        }
-        else if (isSqlite)
-        {
-            QString yamlPath = QDir(info.absolutePath()).filePath("translation.yaml");
-            if (QFileInfo::exists(yamlPath))
-            {
-                if (store.load(yamlPath, &error))
-                {
-                    QString saveError;
-                    store.save(path, &saveError);
-                    if (!saveError.isEmpty())
-                        error = saveError;
-                    result.ok = true;
-                    result.store = store;
-                }
-                else
+                const QByteArray migratedHash = TranslationStore::migratedSourceHash(path);
+                if (!migratedHash.isEmpty())
                 {
-                    result.ok = false;
-                    result.error = error;
+                    QFile yaml(yamlPath);
+                    migrate = yaml.open(QIODevice::ReadOnly)
+                              && TranslationStore::sourceHash(yaml.readAll()) != migratedHash;
                 }
             }
-            else
-            {
-                result.ok = false;
-                result.error = QString("Translation not found: %1").arg(path);
-            }
         }
-        else
+
+        if (!info.exists() && !migrate)
         {
             result.ok = false;
             result.error = QString("Translation not found: %1").arg(path);
+            return result;
+        }
+
+        // The parsed YAML goes to the UI right away; the database is written
+        // afterwards by startTranslationMigration()
+        if (store->load(migrate ? yamlPath : path, &error, preferredVersion))
+        {
+            result.ok = true;
+            result.store = store;
+            if (migrate)
+                result.migrationSource = yamlPath;
+        }
+        else
+        {
+            result.ok = false;
+            result.error = error;
         }
         return result;
     });
     watcher->setFuture(future);
 }
 
+// The editor already works on the parsed YAML, so the database is written on
+// a single low priority thread; only a translation save waits for it.
+void MainWindow::startTranslationMigration(const QString &yamlPath, const QString &dbPath)
+{
+    if (m_migrationWatcher)
+        return;
+
+    QFutureInterface<TranslationMigrationResult> task;
+    task.setProgressRange(0, 100);
+    task.reportStarted();
+
+    const QString fileName = QFileInfo(dbPath).fileName();
+    auto watcher = new QFutureWatcher<TranslationMigrationResult>(this);
+    m_migrationWatcher = watcher;
+    connect(watcher, &QFutureWatcherBase::progressValueChanged, this, [this, fileName](int percent) {
+        m_migrationLabel->setText(QString("正在生成 %1：%2%").arg(fileName).arg(percent));
+    });
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, dbPath]() {
+        const TranslationMigrationResult result = watcher->result();
+        watcher->deleteLater();
+        m_migrationWatcher = nullptr;
+        m_migrationLabel->hide();
+        if (!result.ok)
+        {
+            QMessageBox::warning(this, "生成翻译数据库", result.error);
+            return;
+        }
+        // Edits made meanwhile are still dirty and go to the new file on save
+        if (m_translationPath == dbPath)
+            m_translations.adoptSqlite(dbPath);
+    });
+    watcher->setFuture(task.future());
+
+    m_migrationLabel->setText(QString("正在生成 %1：0%").arg(fileName));
+    m_migrationLabel->show();
+
+    QtConcurrent::run(&m_migrationPool, [task, yamlPath, dbPath]() mutable {
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        TranslationMigrationResult result;
+        result.ok = TranslationStore::migrateYamlToSqlite(yamlPath, dbPath, [&task](int written, int total) {
+            task.setProgressValue(total > 0 ? written * 100 / total : 100);
+        }, &result.error);
+        task.reportResult(result);
+        task.reportFinished();
+    });
+}
+
 void MainWindow::mergeTranslations()
 {
     QVector<ConfigEntry> &entries = m_parser.entries();
     for (ConfigEntry &entry : entries)
     {
         entry.section.clear();
-        if (m_translations.contains(entry.key))
+        // One lookup per entry; the strings are shared with the store, not copied
+        if (const TranslationItem *item = m_translations.find(entry.key))
         {
-            TranslationItem item = m_translations.item(entry.key);
-            entry.section = item.section;
-            entry.nameZh = item.nameZh;
-            entry.descriptionZh = item.descriptionZh;
+            entry.section = m_parser.internText(item->section);
+            entry.nameZh = item->nameZh;
+            entry.descriptionZh = item->descriptionZh;
         }
     }
 
@@ -812,6 +967,14 @@ void MainWindow::onSearchChanged(const QString &text)
     m_proxy->setSearchText(text);
 }
 
+void MainWindow::onFuzzySearchToggled(bool checked)
+{
+    m_proxy->setFuzzy(checked);
+
+    QSettings settings("WY", "ConfEdit");
+    settings.setValue("fuzzySearch", checked);
+}
+
 void MainWindow::onSectionChanged()
 {
     QString text;
@@ -833,6 +996,89 @@ void MainWindow::onTableDoubleClicked(const QModelIndex &index)
     openEditDialog(sourceIndex.row());
 }
 
+void MainWindow::onCompareConfig()
+{
+    if (m_confPath.isEmpty())
+    {
+        QMessageBox::warning(this, "配置对比", "请先打开一个配置文件。");
+        return;
+    }
+
+    // The shipped template sits next to the config as <name>.dist
+    QString suggested = m_confPath + ".dist";
+    if (!QFileInfo::exists(suggested))
+        suggested = QFileInfo(m_confPath).absolutePath();
+    QString path = QFileDialog::getOpenFileName(this, "选择对比文件", suggested,
+                                                "配置文件 (*.conf *.dist);;所有文件 (*)");
+    if (path.isEmpty())
+        return;
+
+    ConfDiffDialog dialog(this);
+    QString error;
+    if (!dialog.compare(m_parser, path, &error))
+    {
+        QMessageBox::warning(this, "配置对比", error);
+        return;
+    }
+    dialog.exec();
+}
+
+void MainWindow::onApplyPatch()
+{
+    if (m_confPath.isEmpty())
+    {
+        QMessageBox::warning(this, "批量修改", "请先打开一个配置文件。");
+        return;
+    }
+
+    QString path = QFileDialog::getOpenFileName(this, "选择补丁文件", QFileInfo(m_confPath).absolutePath(),
+                                                "补丁文件 (*.txt *.conf *.json);;所有文件 (*)");
+    if (path.isEmpty())
+        return;
+
+    ConfPatch patch;
+    QString error;
+    if (!patch.load(path, &error))
+    {
+        QMessageBox::warning(this, "批量修改", error);
+        return;
+    }
+
+    const ConfPatchResult result = patch.apply(&m_parser);
+    m_model->notifyRowsChanged(result.changedEntries);
+    if (!result.changedEntries.isEmpty())
+        m_configDirty = true;
+
+    QString summary = QString("已修改 %1 个配置键，%2 个未变化，%3 个未找到。")
+                          .arg(result.changedEntries.size())
+                          .arg(result.unchangedKeys.size())
+                          .arg(result.unknownKeys.size());
+    if (!result.unknownKeys.isEmpty())
+    {
+        const int maxShown = 20;
+        summary += "\n\n未找到的配置键：\n" + result.unknownKeys.mid(0, maxShown).join("\n");
+        if (result.unknownKeys.size() > maxShown)
+            summary += QString("\n……另有 %1 个").arg(result.unknownKeys.size() - maxShown);
+    }
+
+    if (result.changedEntries.isEmpty())
+    {
+        QMessageBox::information(this, "批量修改", summary);
+        return;
+    }
+
+    summary += "\n\n是否立即保存配置文件？";
+    if (QMessageBox::question(this, "批量修改", summary) != QMessageBox::Yes)
+        return;
+
+    if (!m_parser.save(m_confPath, &error))
+    {
+        QMessageBox::warning(this, "保存配置", error);
+        return;
+    }
+    m_configDirty = false;
+}
+
 void MainWindow::openEditDialog(int sourceRow)
 {
     if (sourceRow < 0 || sourceRow >= m_parser.entries().size())
@@ -927,6 +1173,9 @@ void MainWindow::onSaveAll()
 
     if (m_translationDirty)
     {
+        // Saving replaces the file the migration is still writing
+        if (m_migrationWatcher)
+            m_migrationWatcher->waitForFinished();
         if (!m_translations.save(m_translationPath, &error))
         {
             QMessageBox::warning(this, "保存翻译", error);
@@ -947,8 +1196,19 @@ void MainWindow::onVersionChanged(int index)
         version = m_versionCombo->currentText();
     if (version.isEmpty())
         return;
-    if (!m_translations.setCurrentVersion(version))
+    // Switching can read the version from the database and fail; the combo then
+    // goes back to the version still shown
+    QString error;
+    if (!m_translations.setCurrentVersion(version, &error))
+    {
+        QMessageBox::warning(this, "切换翻译版本", error);
+        m_versionCombo->blockSignals(true);
+        const int current = m_versionCombo->findData(m_translations.currentVersion());
+        if (current >= 0)
+            m_versionCombo->setCurrentIndex(current);
+        m_versionCombo->blockSignals(false);
         return;
+    }
 
     QSettings settings("WY", "ConfEdit");
     settings.setValue("translationVersion", version);
@@ -1041,8 +1301,16 @@ void MainWindow::updateFilePathLabel()
     else
     {
         QFileInfo fileInfo(m_confPath);
-        m_filePathLabel->setText(QString("- %1").arg(fileInfo.fileName()));
-        m_filePathLabel->setToolTip(m_confPath);
+        if (m_duplicateKeyCount > 0)
+        {
+            m_filePathLabel->setText(QString("- %1（%2 个重复键）").arg(fileInfo.fileName()).arg(m_duplicateKeyCount));
+            m_filePathLabel->setToolTip(QString("%1\n\n%2").arg(m_confPath, m_duplicateKeyReport));
+        }
+        else
+        {
+            m_filePathLabel->setText(QString("- %1").arg(fileInfo.fileName()));
+            m_filePathLabel->setToolTip(m_confPath);
+        }
     }
 }
 
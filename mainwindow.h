@@ -3,6 +3,7 @@
 #include <QMainWindow>
 #include <QVector>
 #include <QPoint>
+#include <QThreadPool>
 
 #include "confparser.h"
 #include "translationstore.h"
@@ -15,6 +16,7 @@ class QPushButton;
 class EditEntryDialog;
 class QLabel;
 class QComboBox;
+class QFutureWatcherBase;
 
 class MainWindow : public QMainWindow
 {
@@ -31,9 +33,12 @@ protected:
 
 private slots:
     void onSearchChanged(const QString &text);
+    void onFuzzySearchToggled(bool checked);
     void onSectionChanged();
     void onTableDoubleClicked(const QModelIndex &index);
     void onOpenConfig();
+    void onApplyPatch();
+    void onCompareConfig();
     void onSaveAll();
     void onVersionChanged(int index);
 
@@ -42,8 +47,10 @@ private:
     void applyGlobalStyles();
     void loadDefaultFiles();
     void loadConfig(const QString &path);
+    void reportDuplicateKeys();
     void loadTranslation(const QString &path);
     void loadTranslationAsync(const QString &path);
+    void startTranslationMigration(const QString &yamlPath, const QString &dbPath);
     void mergeTranslations();
     void refreshSectionFilter();
     void openEditDialog(int sourceRow);
@@ -59,15 +66,23 @@ private:
     QString m_translationPath;
     bool m_translationDirty = false;
     bool m_configDirty = false;
+    int m_duplicateKeyCount = 0;        // Keys defined more than once in m_confPath
+    QString m_duplicateKeyReport;
+
+    // Background YAML -> SQLite migration of the translations
+    QThreadPool m_migrationPool;
+    QFutureWatcherBase *m_migrationWatcher = nullptr;
 
     ConfigModel *m_model = nullptr;
     ConfigFilterProxy *m_proxy = nullptr;
 
     QLineEdit *m_searchEdit = nullptr;
+    QPushButton *m_fuzzyButton = nullptr;
     QListWidget *m_sectionList = nullptr;
     QTableView *m_table = nullptr;
     QLabel *m_filePathLabel = nullptr;
     QComboBox *m_versionCombo = nullptr;
+    QLabel *m_migrationLabel = nullptr;
 
     // Window dragging
     QWidget *m_topBar = nullptr;
@@ -0,0 +1,231 @@
+#include "translationpack.h"
+#include "confstorage.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kPackMagic[8] = { 'W', 'Y', 'T', 'R', 'P', 'A', 'C', 'K' };
+const quint32 kPackFormat = 1;
+
+// File layout: the header, one VersionRecord per version, the items of every
+// version (ItemRecord, sorted by key), then the string table.
+struct PackHeader
+{
+    char magic[8];
+    quint32 format = 0;
+    quint32 versionCount = 0;
+    quint32 stringTableOffset = 0;   // In bytes from the start of the file
+    quint32 stringTableLength = 0;   // In UTF-16 code units
+};
+
+// Code unit order, the same order QString::operator< uses
+int compareUtf16(QStringView a, QStringView b)
+{
+    const int common = static_cast<int>(qMin(a.size(), b.size()));
+    for (int i = 0; i < common; ++i)
+    {
+        if (a[i] != b[i])
+            return a[i].unicode() < b[i].unicode() ? -1 : 1;
+    }
+    return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+} // namespace
+
+TranslationPack::TranslationPack() = default;
+
+TranslationPack::~TranslationPack() = default;
+
+bool TranslationPack::write(const QString &path, const QStringList &versions,
+                            const TranslationTable &items, QString *error)
+{
+    QString strings;
+    QHash<QString, StringRef> stringIds;
+    auto addString = [&](const QString &text) {
+        auto it = stringIds.constFind(text);
+        if (it != stringIds.constEnd())
+            return it.value();
+        StringRef id;
+        id.offset = strings.size();
+        id.length = text.size();
+        strings += text;
+        stringIds.insert(text, id);
+        return id;
+    };
+
+    QVector<VersionRecord> versionRecords;
+    QVector<ItemRecord> itemRecords;
+    quint32 itemsOffset = sizeof(PackHeader) + versions.size() * sizeof(VersionRecord);
+    for (int id = 0; id < versions.size(); ++id)
+    {
+        const QString &version = versions[id];
+        QVector<const TranslationItem *> sorted = items.items(id);
+        std::sort(sorted.begin(), sorted.end(), [](const TranslationItem *a, const TranslationItem *b) {
+            return compareUtf16(a->key, b->key) < 0;
+        });
+
+        VersionRecord record;
+        record.name = addString(version);
+        record.itemCount = sorted.size();
+        record.itemsOffset = itemsOffset;
+        versionRecords.push_back(record);
+        itemsOffset += sorted.size() * sizeof(ItemRecord);
+
+        for (const TranslationItem *item : sorted)
+        {
+            ItemRecord itemRecord;
+            itemRecord.key = addString(item->key);
+            itemRecord.section = addString(item->section);
+            itemRecord.nameZh = addString(item->nameZh);
+            itemRecord.descriptionZh = addString(item->descriptionZh);
+            itemRecords.push_back(itemRecord);
+        }
+    }
+
+    PackHeader header;
+    std::memcpy(header.magic, kPackMagic, sizeof(header.magic));
+    header.format = kPackFormat;
+    header.versionCount = versionRecords.size();
+    header.stringTableOffset = itemsOffset;
+    header.stringTableLength = strings.size();
+
+    QByteArray out;
+    out.reserve(itemsOffset + strings.size() * 2);
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(versionRecords.constData()), versionRecords.size() * sizeof(VersionRecord));
+    out.append(reinterpret_cast<const char *>(itemRecords.constData()), itemRecords.size() * sizeof(ItemRecord));
+    out.append(reinterpret_cast<const char *>(strings.utf16()), strings.size() * 2);
+
+    if (!writeFileAtomically(path, out, error))
+    {
+        if (error)
+            *error = QString("Failed to write translation: %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool TranslationPack::open(const QString &path, QString *error)
+{
+    auto fail = [&]() {
+        if (error)
+            *error = QString("Invalid translation pack: %1").arg(path);
+        m_file.reset();
+        m_map = nullptr;
+        m_versions = nullptr;
+        m_versionCount = 0;
+        m_strings = nullptr;
+        m_versionNames.clear();
+        return false;
+    };
+
+    m_file.reset(new QFile(path));
+    if (!m_file->open(QIODevice::ReadOnly))
+    {
+        m_file.reset();
+        if (error)
+            *error = QString("Failed to open translation: %1").arg(path);
+        return false;
+    }
+
+    const qint64 size = m_file->size();
+    if (size < static_cast<qint64>(sizeof(PackHeader)))
+        return fail();
+    m_map = m_file->map(0, size);
+    if (!m_map)
+        return fail();
+
+    PackHeader header;
+    std::memcpy(&header, m_map, sizeof(header));
+    if (std::memcmp(header.magic, kPackMagic, sizeof(header.magic)) != 0 || header.format != kPackFormat)
+        return fail();
+
+    // Every offset is checked once here so lookups can trust the tables
+    const qint64 versionsEnd = sizeof(PackHeader) + qint64(header.versionCount) * sizeof(VersionRecord);
+    const qint64 stringsEnd = header.stringTableOffset + qint64(header.stringTableLength) * 2;
+    if (versionsEnd > header.stringTableOffset || stringsEnd > size || header.stringTableOffset % 4 != 0)
+        return fail();
+
+    m_versions = reinterpret_cast<const VersionRecord *>(m_map + sizeof(PackHeader));
+    m_versionCount = static_cast<int>(header.versionCount);
+    m_strings = reinterpret_cast<const char16_t *>(m_map + header.stringTableOffset);
+
+    auto validString = [&](const StringRef &s) {
+        return qint64(s.offset) + s.length <= header.stringTableLength;
+    };
+    for (quint32 v = 0; v < header.versionCount; ++v)
+    {
+        const VersionRecord &version = m_versions[v];
+        const qint64 itemsEnd = version.itemsOffset + qint64(version.itemCount) * sizeof(ItemRecord);
+        if (!validString(version.name) || version.itemsOffset < versionsEnd ||
+            version.itemsOffset % 4 != 0 || itemsEnd > header.stringTableOffset)
+        {
+            return fail();
+        }
+        const ItemRecord *records = items(static_cast<int>(v));
+        for (quint32 i = 0; i < version.itemCount; ++i)
+        {
+            const ItemRecord &item = records[i];
+            if (!validString(item.key) || !validString(item.section) ||
+                !validString(item.nameZh) || !validString(item.descriptionZh))
+            {
+                return fail();
+            }
+        }
+        m_versionNames << string(version.name.offset, version.name.length);
+    }
+    return true;
+}
+
+int TranslationPack::itemCount(int version) const
+{
+    if (version < 0 || version >= m_versionCount)
+        return 0;
+    return static_cast<int>(m_versions[version].itemCount);
+}
+
+int TranslationPack::find(int version, QStringView key) const
+{
+    const ItemRecord *records = items(version);
+    const ItemRecord *end = records + itemCount(version);
+    const ItemRecord *it = std::lower_bound(records, end, key, [this](const ItemRecord &item, QStringView k) {
+        return compareUtf16(view(item.key.offset, item.key.length), k) < 0;
+    });
+    if (it == end || compareUtf16(view(it->key.offset, it->key.length), key) != 0)
+        return -1;
+    return static_cast<int>(it - records);
+}
+
+TranslationItem TranslationPack::itemAt(int version, int index) const
+{
+    TranslationItem result;
+    if (index < 0 || index >= itemCount(version))
+        return result;
+    const ItemRecord &item = items(version)[index];
+    result.key = string(item.key.offset, item.key.length);
+    result.section = string(item.section.offset, item.section.length);
+    result.nameZh = string(item.nameZh.offset, item.nameZh.length);
+    result.descriptionZh = string(item.descriptionZh.offset, item.descriptionZh.length);
+    return result;
+}
+
+const TranslationPack::ItemRecord *TranslationPack::items(int version) const
+{
+    if (version < 0 || version >= m_versionCount)
+        return nullptr;
+    return reinterpret_cast<const ItemRecord *>(m_map + m_versions[version].itemsOffset);
+}
+
+QString TranslationPack::string(quint32 offset, quint32 length) const
+{
+    return QString(reinterpret_cast<const QChar *>(m_strings + offset), static_cast<int>(length));
+}
+
+QStringView TranslationPack::view(quint32 offset, quint32 length) const
+{
+    return QStringView(m_strings + offset, static_cast<qsizetype>(length));
+}
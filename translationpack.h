@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QHash>
+#include <QScopedPointer>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+#include "translationstore.h"
+
+class QFile;
+
+// Read-only view of a binary translation pack (.wypack). The file is mapped
+// and queried in place: every version has its items sorted by key, and all
+// strings live in one deduplicated UTF-16 table, so opening a pack allocates
+// nothing per item.
+class TranslationPack
+{
+public:
+    TranslationPack();
+    ~TranslationPack();
+
+    // The items of versions[i] are the ones stored under version id i
+    static bool write(const QString &path, const QStringList &versions,
+                      const TranslationTable &items, QString *error);
+
+    bool open(const QString &path, QString *error);
+
+    const QStringList &versions() const { return m_versionNames; }
+    int versionIndex(const QString &name) const { return m_versionNames.indexOf(name); }
+    int itemCount(int version) const;
+
+    // Index of key in the version's sorted items, or -1
+    int find(int version, QStringView key) const;
+    TranslationItem itemAt(int version, int index) const;
+
+private:
+    Q_DISABLE_COPY(TranslationPack)
+
+    struct StringRef
+    {
+        quint32 offset = 0;   // UTF-16 code units from the start of the string table
+        quint32 length = 0;
+    };
+
+    struct VersionRecord
+    {
+        StringRef name;
+        quint32 itemCount = 0;
+        quint32 itemsOffset = 0;   // Bytes from the start of the file
+    };
+
+    struct ItemRecord
+    {
+        StringRef key;
+        StringRef section;
+        StringRef nameZh;
+        StringRef descriptionZh;
+    };
+
+    const ItemRecord *items(int version) const;
+    QString string(quint32 offset, quint32 length) const;
+    QStringView view(quint32 offset, quint32 length) const;
+
+    QScopedPointer<QFile> m_file;
+    const uchar *m_map = nullptr;
+    const VersionRecord *m_versions = nullptr;
+    int m_versionCount = 0;
+    const char16_t *m_strings = nullptr;
+    QStringList m_versionNames;
+};
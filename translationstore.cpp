@@ -1,12 +1,18 @@
 #include "translationstore.h"
+#include "translationpack.h"
 
 #include <algorithm>
+#include <functional>
 #include <QFile>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QRegularExpression>
 #include <QTextStream>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QUuid>
+#include <QtEndian>
 
 static bool isSqlitePath(const QString &path)
 {
@@ -14,7 +20,12 @@ static bool isSqlitePath(const QString &path)
     return lower.endsWith(".db") || lower.endsWith(".sqlite") || lower.endsWith(".sqlite3");
 }
 
-static QString stripQuotes(const QString &value)
+static bool isPackPath(const QString &path)
+{
+    return path.endsWith(".wypack", Qt::CaseInsensitive);
+}
+
+static QStringRef stripQuotes(const QStringRef &value)
 {
     if (value.size() >= 2)
     {
@@ -38,14 +49,14 @@ static QString formatYamlValue(const QString &value)
     return QString("\"") + escaped + QString("\"");
 }
 
-static bool parseKeyValue(const QString &line, QString *keyOut, QString *valueOut)
+static bool parseKeyValue(const QStringRef &line, QStringRef *keyOut, QStringRef *valueOut)
 {
     int colon = line.indexOf(':');
     if (colon < 0)
         return false;
 
-    QString key = line.left(colon).trimmed();
-    QString value = line.mid(colon + 1).trimmed();
+    QStringRef key = line.left(colon).trimmed();
+    QStringRef value = line.mid(colon + 1).trimmed();
     if (key.isEmpty())
         return false;
 
@@ -56,40 +67,486 @@ static bool parseKeyValue(const QString &line, QString *keyOut, QString *valueOu
     return true;
 }
 
-static bool ensureSqliteSchema(QSqlDatabase &db, QString *error)
+// Returns the line starting at *pos without its terminator and moves *pos
+// past it
+static QStringRef nextLine(const QString &text, int *pos)
+{
+    const int begin = *pos;
+    int end = text.indexOf('\n', begin);
+    if (end < 0)
+        end = text.size();
+    *pos = end + 1;
+
+    int contentEnd = end;
+    if (contentEnd > begin && text[contentEnd - 1] == '\r')
+        --contentEnd;
+    return text.midRef(begin, contentEnd - begin);
+}
+
+// Schema history (PRAGMA user_version):
+//   0 - items held section/name_zh/description_zh as text columns
+//   1 - items reference a deduplicated texts table by id. texts.text has no
+//       UNIQUE index (it would store every text twice); writers keep it unique.
+//       items is WITHOUT ROWID, its primary key also serves lookups by version.
+//   2 - texts.hash (indexed) finds a text without reading the table, and
+//       texts.refs counts the item columns using it, so a save only drops
+//       the texts its own items stopped using.
+// meta holds name/value pairs, e.g. the hash of the YAML file a database was
+// migrated from.
+// items_fts is not versioned: it is only created when the SQLite build has
+// FTS5, and rebuilt from items when it is missing.
+static const int kSqliteSchemaVersion = 2;
+
+// Items per transaction when a save reports progress
+static const int kSaveBatchSize = 500;
+
+static bool execSql(QSqlQuery &q, const QString &sql, QString *error)
+{
+    if (q.exec(sql))
+        return true;
+    if (error)
+        *error = q.lastError().text();
+    return false;
+}
+
+static bool createSqliteTables(QSqlQuery &q, QString *error)
+{
+    return execSql(q, "CREATE TABLE IF NOT EXISTS versions (name TEXT PRIMARY KEY, ord INTEGER)", error) &&
+           execSql(q, "CREATE TABLE IF NOT EXISTS meta (name TEXT PRIMARY KEY, value BLOB)", error) &&
+           execSql(q, "CREATE TABLE IF NOT EXISTS texts (id INTEGER PRIMARY KEY, hash INTEGER NOT NULL DEFAULT 0, "
+                      "refs INTEGER NOT NULL DEFAULT 0, text TEXT NOT NULL)", error) &&
+           execSql(q, "CREATE INDEX IF NOT EXISTS texts_hash ON texts(hash)", error) &&
+           execSql(q, "CREATE TABLE IF NOT EXISTS items (version TEXT NOT NULL, key TEXT NOT NULL, "
+                      "section_id INTEGER REFERENCES texts(id), name_id INTEGER REFERENCES texts(id), "
+                      "description_id INTEGER REFERENCES texts(id), PRIMARY KEY(version, key)) WITHOUT ROWID", error);
+}
+
+// First 64 bits of the SHA-1 of the UTF-16 text; stable across Qt versions,
+// unlike qHash
+static qint64 textHash(const QString &text)
+{
+    const QByteArray digest = QCryptographicHash::hash(
+        QByteArray::fromRawData(reinterpret_cast<const char *>(text.utf16()), text.size() * 2),
+        QCryptographicHash::Sha1);
+    return qFromLittleEndian<qint64>(digest.constData());
+}
+
+// Recomputes texts.hash and texts.refs of every text; only used by migrations
+static bool fillTextBookkeeping(QSqlDatabase &db, QString *error)
 {
     QSqlQuery q(db);
-    if (!q.exec("CREATE TABLE IF NOT EXISTS versions (name TEXT PRIMARY KEY, ord INTEGER)"))
+    q.setForwardOnly(true);
+    if (!execSql(q, "SELECT section_id, name_id, description_id FROM items", error))
+        return false;
+    QHash<qint64, int> refs;
+    while (q.next())
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            if (!q.isNull(column))
+                ++refs[q.value(column).toLongLong()];
+        }
+    }
+
+    QVector<QPair<qint64, QString>> texts;
+    if (!execSql(q, "SELECT id, text FROM texts", error))
+        return false;
+    while (q.next())
+        texts.push_back(qMakePair(q.value(0).toLongLong(), q.value(1).toString()));
+
+    QSqlQuery update(db);
+    update.prepare("UPDATE texts SET hash = ?, refs = ? WHERE id = ?");
+    for (const auto &text : texts)
+    {
+        update.addBindValue(textHash(text.second));
+        update.addBindValue(refs.value(text.first));
+        update.addBindValue(text.first);
+        if (!update.exec())
+        {
+            if (error)
+                *error = update.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs a schema migration in one transaction
+static bool migrateInTransaction(QSqlDatabase &db, QString *error, const std::function<bool()> &steps)
+{
+    if (!db.transaction())
     {
         if (error)
-            *error = q.lastError().text();
+            *error = db.lastError().text();
+        return false;
+    }
+    const bool ok = steps();
+    if (!ok || !db.commit())
+    {
+        if (ok && error)
+            *error = db.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+// Adds the hash and reference count columns of version 2
+static bool migrateSqliteV1(QSqlDatabase &db, QString *error)
+{
+    QSqlQuery q(db);
+    return migrateInTransaction(db, error, [&]() {
+        return execSql(q, "ALTER TABLE texts ADD COLUMN hash INTEGER NOT NULL DEFAULT 0", error) &&
+               execSql(q, "ALTER TABLE texts ADD COLUMN refs INTEGER NOT NULL DEFAULT 0", error) &&
+               fillTextBookkeeping(db, error) &&
+               execSql(q, "CREATE INDEX IF NOT EXISTS texts_hash ON texts(hash)", error) &&
+               execSql(q, QString("PRAGMA user_version = %1").arg(kSqliteSchemaVersion), error);
+    });
+}
+
+// Moves a version 0 database to the texts table in one transaction
+static bool migrateSqliteV0(QSqlDatabase &db, QString *error)
+{
+    QSqlQuery q(db);
+    const bool ok = migrateInTransaction(db, error, [&]() {
+        return
+        execSql(q, "ALTER TABLE items RENAME TO items_v0", error) &&
+        execSql(q, "DROP INDEX IF EXISTS idx_items_version", error) &&
+        createSqliteTables(q, error) &&
+        execSql(q, "INSERT INTO texts(text) "
+                   "SELECT section FROM items_v0 WHERE section <> '' "
+                   "UNION SELECT name_zh FROM items_v0 WHERE name_zh <> '' "
+                   "UNION SELECT description_zh FROM items_v0 WHERE description_zh <> ''", error) &&
+        // Only needed to map the old columns to ids
+        execSql(q, "CREATE INDEX texts_migration ON texts(text)", error) &&
+        execSql(q, "INSERT INTO items(version, key, section_id, name_id, description_id) "
+                   "SELECT version, key, "
+                   "(SELECT id FROM texts WHERE text = section), "
+                   "(SELECT id FROM texts WHERE text = name_zh), "
+                   "(SELECT id FROM texts WHERE text = description_zh) FROM items_v0", error) &&
+        execSql(q, "DROP INDEX texts_migration", error) &&
+        execSql(q, "DROP TABLE items_v0", error) &&
+        fillTextBookkeeping(db, error) &&
+        execSql(q, QString("PRAGMA user_version = %1").arg(kSqliteSchemaVersion), error);
+    });
+    if (!ok)
+        return false;
+
+    // Hand the space of the old text columns back to the file system
+    q.exec("VACUUM");
+    return true;
+}
+
+static bool isCjk(QChar ch)
+{
+    switch (ch.script())
+    {
+    case QChar::Script_Han:
+    case QChar::Script_Hiragana:
+    case QChar::Script_Katakana:
+    case QChar::Script_Hangul:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// FTS5's unicode61 tokenizer keeps a run of CJK characters as one token, so
+// each run is indexed as overlapping bigrams plus its last character
+// ("数据库" -> "数据 据库 库"). Every substring of two or more characters is
+// then a phrase of bigrams, and every single character starts a token.
+static QString searchText(const QString &text)
+{
+    QString out;
+    out.reserve(text.size() * 3);
+    for (int i = 0; i < text.size(); ++i)
+    {
+        if (!isCjk(text[i]))
+        {
+            out += text[i];
+            continue;
+        }
+
+        int end = i + 1;
+        while (end < text.size() && isCjk(text[end]))
+            ++end;
+        out += ' ';
+        for (int j = i; j + 1 < end; ++j)
+        {
+            out += text[j];
+            out += text[j + 1];
+            out += ' ';
+        }
+        out += text[end - 1];
+        out += ' ';
+        i = end - 1;
+    }
+    return out;
+}
+
+// "MaxPlayerLevel" -> "Max Player Level", "XPRate" -> "XP Rate"
+static QString keyWords(const QString &key)
+{
+    QString out;
+    out.reserve(key.size() + 8);
+    for (int i = 0; i < key.size(); ++i)
+    {
+        const QChar ch = key[i];
+        if (i > 0 && ch.isUpper())
+        {
+            const QChar prev = key[i - 1];
+            const bool nextLower = i + 1 < key.size() && key[i + 1].isLower();
+            if (prev.isLower() || prev.isDigit() || (prev.isUpper() && nextLower))
+                out += ' ';
+        }
+        out += ch;
+    }
+    return out;
+}
+
+// The query side of searchText: a CJK run becomes its bigrams only, since
+// the trailing single character of the index is a token of its own and would
+// break the phrase ("倍率" must not become "倍率 率"). A lone CJK character
+// stays as it is and matches as a prefix of the bigram it starts.
+static QString searchPhraseWords(const QString &term)
+{
+    QString out;
+    out.reserve(term.size() * 3);
+    for (int i = 0; i < term.size(); ++i)
+    {
+        if (!isCjk(term[i]))
+        {
+            out += term[i];
+            continue;
+        }
+
+        int end = i + 1;
+        while (end < term.size() && isCjk(term[end]))
+            ++end;
+        out += ' ';
+        if (end - i == 1)
+            out += term[i];
+        for (int j = i; j + 1 < end; ++j)
+        {
+            out += term[j];
+            out += term[j + 1];
+            out += ' ';
+        }
+        out += ' ';
+        i = end - 1;
+    }
+    return out;
+}
+
+// Every whitespace separated term has to match. A term becomes one phrase,
+// split at camel case humps like the indexed keys ("MaxPlayer" -> "Max
+// Player"); the last word also matches as a prefix unless it is a bigram.
+static QString searchQuery(const QString &query)
+{
+    QStringList phrases;
+    for (QString term : query.split(QRegularExpression("\\s+"), QString::SkipEmptyParts))
+    {
+        term.remove('"');
+        const QString words = searchPhraseWords(keyWords(term)).simplified();
+        if (words.isEmpty())
+            continue;
+        const int last = term.size() - 1;
+        const bool prefix = !isCjk(term[last]) || last == 0 || !isCjk(term[last - 1]);
+        phrases.append(QString("\"%1\"%2").arg(words, prefix ? "*" : ""));
+    }
+    return phrases.join(' ');
+}
+
+static bool insertSearchRow(QSqlQuery &insert, const QString &version, const QString &key,
+                            const QString &nameZh, const QString &descriptionZh)
+{
+    insert.addBindValue(version);
+    insert.addBindValue(key);
+    insert.addBindValue(keyWords(key));
+    insert.addBindValue(searchText(nameZh));
+    insert.addBindValue(searchText(descriptionZh));
+    return insert.exec();
+}
+
+static const char *const kInsertSearchRowSql =
+    "INSERT INTO items_fts(version, key, key_words, name_zh, description_zh) VALUES(?, ?, ?, ?, ?)";
+
+// The search index is optional: a database without it still loads and saves
+static bool hasSearchIndex(QSqlDatabase &db)
+{
+    QSqlQuery q(db);
+    return q.exec("SELECT rowid FROM items_fts LIMIT 0");
+}
+
+static bool ensureSearchIndex(QSqlDatabase &db, QString *error)
+{
+    QSqlQuery q(db);
+    if (!execSql(q, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'items_fts'", error) || !q.next())
+        return false;
+    if (q.value(0).toInt() > 0)
+        return true;
+
+    if (!db.transaction())
+    {
+        if (error)
+            *error = db.lastError().text();
+        return false;
+    }
+    // Fails without FTS5; the store then works as before, only search() is unavailable
+    if (!q.exec("CREATE VIRTUAL TABLE items_fts USING fts5("
+                "version UNINDEXED, key UNINDEXED, key_words, name_zh, description_zh, "
+                "tokenize = 'unicode61')"))
+    {
+        db.rollback();
+        return true;
+    }
+
+    QSqlQuery select(db);
+    select.setForwardOnly(true);
+    QSqlQuery insert(db);
+    insert.prepare(kInsertSearchRowSql);
+    bool ok = execSql(select, "SELECT i.version, i.key, n.text, d.text FROM items i "
+                              "LEFT JOIN texts n ON n.id = i.name_id "
+                              "LEFT JOIN texts d ON d.id = i.description_id", error);
+    while (ok && select.next())
+    {
+        ok = insertSearchRow(insert, select.value(0).toString(), select.value(1).toString(),
+                             select.value(2).toString(), select.value(3).toString());
+        if (!ok && error)
+            *error = insert.lastError().text();
+    }
+
+    if (!ok || !db.commit())
+    {
+        if (ok && error)
+            *error = db.lastError().text();
+        db.rollback();
         return false;
     }
-    if (!q.exec("CREATE TABLE IF NOT EXISTS items (version TEXT NOT NULL, key TEXT NOT NULL, section TEXT, name_zh TEXT, description_zh TEXT, PRIMARY KEY(version, key))"))
+    return true;
+}
+
+static bool ensureSqliteSchema(QSqlDatabase &db, QString *error)
+{
+    QSqlQuery q(db);
+    // WAL keeps readers unblocked while a save is in progress; the mode is
+    // stored in the database file, so setting it again is a no-op
+    if (!execSql(q, "PRAGMA journal_mode=WAL", error) || !execSql(q, "PRAGMA synchronous=NORMAL", error))
+        return false;
+
+    if (!execSql(q, "PRAGMA user_version", error) || !q.next())
+        return false;
+    const int schemaVersion = q.value(0).toInt();
+    if (schemaVersion > kSqliteSchemaVersion)
     {
         if (error)
-            *error = q.lastError().text();
+            *error = QString("Unsupported translation database version: %1").arg(schemaVersion);
         return false;
     }
-    if (!q.exec("CREATE INDEX IF NOT EXISTS idx_items_version ON items(version)"))
+    if (schemaVersion == kSqliteSchemaVersion)
+        return createSqliteTables(q, error) && ensureSearchIndex(db, error);
+    if (schemaVersion == 1)
+        return migrateSqliteV1(db, error) && createSqliteTables(q, error) && ensureSearchIndex(db, error);
+
+    // Version 0 is either a new file or one with the old text columns
+    if (!execSql(q, "SELECT COUNT(*) FROM pragma_table_info('items') WHERE name = 'description_zh'", error) || !q.next())
+        return false;
+    if (q.value(0).toInt() > 0)
+        return migrateSqliteV0(db, error) && ensureSearchIndex(db, error);
+
+    return createSqliteTables(q, error) &&
+           execSql(q, QString("PRAGMA user_version = %1").arg(kSqliteSchemaVersion), error) &&
+           ensureSearchIndex(db, error);
+}
+
+// The read-only counterpart of ensureSqliteSchema(): versions 1 and up share
+// the tables a load reads, older or newer files are refused instead of migrated
+static bool checkSqliteSchema(QSqlDatabase &db, QString *error)
+{
+    QSqlQuery q(db);
+    if (!execSql(q, "PRAGMA user_version", error) || !q.next())
+        return false;
+    const int schemaVersion = q.value(0).toInt();
+    if (schemaVersion >= 1 && schemaVersion <= kSqliteSchemaVersion)
+        return true;
+    if (error)
+        *error = QString("Translation database version %1 cannot be read without migrating it: %2")
+                     .arg(schemaVersion).arg(db.databaseName());
+    return false;
+}
+
+static bool queryVersionItems(QSqlDatabase &db, const QString &version, int versionId,
+                              TranslationTable *items, QString *error)
+{
+    QSqlQuery qi(db);
+    qi.setForwardOnly(true);
+    qi.prepare("SELECT i.key, s.text, n.text, d.text FROM items i "
+               "LEFT JOIN texts s ON s.id = i.section_id "
+               "LEFT JOIN texts n ON n.id = i.name_id "
+               "LEFT JOIN texts d ON d.id = i.description_id "
+               "WHERE i.version = ?");
+    qi.addBindValue(version);
+    if (!qi.exec())
     {
         if (error)
-            *error = q.lastError().text();
+            *error = qi.lastError().text();
         return false;
     }
+    while (qi.next())
+    {
+        TranslationItem item;
+        item.key = qi.value(0).toString();
+        item.section = qi.value(1).toString();
+        item.nameZh = qi.value(2).toString();
+        item.descriptionZh = qi.value(3).toString();
+        if (!item.key.isEmpty())
+            items->insert(versionId, item);
+    }
     return true;
 }
 
-bool TranslationStore::loadFromSqlite(const QString &path, QString *error)
+void TranslationStore::reset()
 {
-    m_versions.clear();
+    m_items.clear();
     m_versionOrder.clear();
     m_currentVersion.clear();
+    m_currentId = -1;
+    m_dirtyKeys.clear();
+    m_syncedPath.clear();
+    m_unfetchedVersions.clear();
+    m_pack.reset();
+    m_packVersions.clear();
+}
+
+void TranslationStore::adoptSqlite(const QString &path)
+{
+    if (m_syncedPath.isEmpty() && !m_pack)
+        m_syncedPath = QFileInfo(path).absoluteFilePath();
+}
+
+// Returns the id of version, adding it after the known versions if needed
+int TranslationStore::addVersion(const QString &version)
+{
+    int id = m_versionOrder.indexOf(version);
+    if (id < 0)
+    {
+        id = m_versionOrder.size();
+        m_versionOrder.append(version);
+    }
+    return id;
+}
+
+bool TranslationStore::loadFromSqlite(const QString &path, QString *error, const QString &preferredVersion)
+{
+    reset();
 
     const QString connName = QString("translation_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
     {
         QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
         db.setDatabaseName(path);
+        // Read-only also keeps QSQLITE from creating a missing file
+        if (m_readOnly)
+            db.setConnectOptions("QSQLITE_OPEN_READONLY");
         if (!db.open())
         {
             if (error)
@@ -98,7 +555,7 @@ bool TranslationStore::loadFromSqlite(const QString &path, QString *error)
             return false;
         }
 
-        if (!ensureSqliteSchema(db, error))
+        if (m_readOnly ? !checkSqliteSchema(db, error) : !ensureSqliteSchema(db, error))
         {
             db.close();
             QSqlDatabase::removeDatabase(connName);
@@ -118,50 +575,150 @@ bool TranslationStore::loadFromSqlite(const QString &path, QString *error)
         while (q.next())
         {
             QString version = q.value(0).toString();
-            if (!version.isEmpty() && !m_versions.contains(version))
+            if (!version.isEmpty() && !m_versionOrder.contains(version))
             {
-                m_versions.insert(version, QHash<QString, TranslationItem>());
                 m_versionOrder.append(version);
+                m_unfetchedVersions.insert(version);
             }
         }
 
-        for (const QString &version : m_versionOrder)
+        if (!m_versionOrder.isEmpty())
         {
-            QSqlQuery qi(db);
-            qi.prepare("SELECT key, section, name_zh, description_zh FROM items WHERE version = ? ORDER BY key ASC");
-            qi.addBindValue(version);
-            if (!qi.exec())
+            m_currentId = qMax(0, m_versionOrder.indexOf(preferredVersion));
+            m_currentVersion = m_versionOrder[m_currentId];
+            if (!queryVersionItems(db, m_currentVersion, m_currentId, &m_items, error))
             {
-                if (error)
-                    *error = qi.lastError().text();
                 db.close();
                 QSqlDatabase::removeDatabase(connName);
                 return false;
             }
-            while (qi.next())
+            m_unfetchedVersions.remove(m_currentVersion);
+        }
+
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connName);
+    m_syncedPath = QFileInfo(path).absoluteFilePath();
+    return true;
+}
+
+bool TranslationStore::fetchVersion(const QString &version, QString *error)
+{
+    if (!m_unfetchedVersions.contains(version))
+        return true;
+
+    const QString connName = QString("translation_fetch_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
+        db.setDatabaseName(m_syncedPath);
+        if (m_readOnly)
+            db.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (db.open())
+        {
+            // Rows are only kept once the whole query went through
+            TranslationTable items;
+            ok = queryVersionItems(db, version, 0, &items, error);
+            if (ok)
             {
-                TranslationItem item;
-                item.key = qi.value(0).toString();
-                item.section = qi.value(1).toString();
-                item.nameZh = qi.value(2).toString();
-                item.descriptionZh = qi.value(3).toString();
-                if (!item.key.isEmpty())
-                    m_versions[version].insert(item.key, item);
+                const int id = m_versionOrder.indexOf(version);
+                m_items.reserve(m_items.size() + items.size());
+                for (const TranslationItem *item : items.items(0))
+                    m_items.insert(id, *item);
+                m_unfetchedVersions.remove(version);
             }
+            db.close();
+        }
+        else if (error)
+        {
+            *error = db.lastError().text();
         }
+    }
+    QSqlDatabase::removeDatabase(connName);
+    return ok;
+}
 
-        if (!m_versionOrder.isEmpty())
-            m_currentVersion = m_versionOrder.first();
+bool TranslationStore::fetchAllVersions(QString *error)
+{
+    const QSet<QString> versions = m_unfetchedVersions;
+    for (const QString &version : versions)
+    {
+        if (!fetchVersion(version, error))
+            return false;
+    }
 
-        db.close();
+    const QSet<QString> packed = m_packVersions;
+    for (const QString &version : packed)
+        unpackVersion(version);
+    m_pack.reset();
+    return true;
+}
+
+bool TranslationStore::loadFromPack(const QString &path, QString *error, const QString &preferredVersion)
+{
+    reset();
+
+    QSharedPointer<TranslationPack> pack(new TranslationPack());
+    if (!pack->open(path, error))
+        return false;
+
+    for (const QString &version : pack->versions())
+    {
+        if (version.isEmpty() || m_versionOrder.contains(version))
+            continue;
+        m_versionOrder.append(version);
+        m_packVersions.insert(version);
+    }
+    m_pack = pack;
+
+    // Every version stays mapped and is queried in place until it is edited
+    if (!m_versionOrder.isEmpty())
+    {
+        m_currentId = qMax(0, m_versionOrder.indexOf(preferredVersion));
+        m_currentVersion = m_versionOrder[m_currentId];
     }
-    QSqlDatabase::removeDatabase(connName);
     return true;
 }
 
-bool TranslationStore::saveToSqlite(const QString &path, QString *error) const
+// Copies a version out of the pack so it can be edited
+void TranslationStore::unpackVersion(const QString &version)
+{
+    if (!m_packVersions.remove(version))
+        return;
+
+    const int id = m_versionOrder.indexOf(version);
+    const int index = m_pack->versionIndex(version);
+    const int count = m_pack->itemCount(index);
+    m_items.reserve(m_items.size() + count);
+    for (int i = 0; i < count; ++i)
+        m_items.insert(id, m_pack->itemAt(index, i));
+}
+
+bool TranslationStore::saveToPack(const QString &path, QString *error)
+{
+    // Unpacking everything also releases the mapping, so the pack being
+    // replaced can be the one that was loaded
+    if (!fetchAllVersions(error))
+        return false;
+
+    return TranslationPack::write(path, m_versionOrder, m_items, error);
+}
+
+// Everything is written in a single transaction. A save to the synced file
+// upserts only the dirty items; any other target is rewritten completely.
+bool TranslationStore::saveToSqlite(const QString &path, QString *error, const SaveProgress &progress)
 {
+    const QString absolutePath = QFileInfo(path).absoluteFilePath();
+    const bool incremental = !m_syncedPath.isEmpty() && absolutePath == m_syncedPath;
+    if (incremental && m_dirtyKeys.isEmpty())
+        return true;
+
+    // A full rewrite needs every version in memory
+    if (!incremental && !fetchAllVersions(error))
+        return false;
+
     const QString connName = QString("translation_save_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    bool ok = false;
     {
         QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
         db.setDatabaseName(path);
@@ -180,95 +737,288 @@ bool TranslationStore::saveToSqlite(const QString &path, QString *error) const
             return false;
         }
 
+        auto fail = [&](const QSqlQuery &q) {
+            if (error)
+                *error = q.lastError().text();
+            db.rollback();
+        };
+
+        ok = db.transaction();
+        if (!ok && error)
+            *error = db.lastError().text();
+
+        const bool searchIndex = hasSearchIndex(db);
         QSqlQuery clear(db);
-        if (!clear.exec("DELETE FROM items"))
+        if (ok && !incremental)
         {
-            if (error)
-                *error = clear.lastError().text();
-            db.close();
-            QSqlDatabase::removeDatabase(connName);
-            return false;
+            if (!clear.exec("DELETE FROM items") || !clear.exec("DELETE FROM versions") ||
+                !clear.exec("DELETE FROM texts") || (searchIndex && !clear.exec("DELETE FROM items_fts")))
+            {
+                fail(clear);
+                ok = false;
+            }
         }
-        if (!clear.exec("DELETE FROM versions"))
+
+        // Once saved from the editor the file no longer mirrors its YAML source;
+        // a migration writes the hash again after this
+        QSqlQuery clearSource(db);
+        if (ok && !clearSource.exec("DELETE FROM meta WHERE name = 'source_sha256'"))
         {
-            if (error)
-                *error = clear.lastError().text();
-            db.close();
-            QSqlDatabase::removeDatabase(connName);
-            return false;
+            fail(clearSource);
+            ok = false;
         }
 
-        QSqlQuery insertVersion(db);
-        insertVersion.prepare("INSERT INTO versions(name, ord) VALUES(?, ?)");
-        int order = 0;
-        QStringList versions = m_versionOrder;
-        if (versions.isEmpty())
-            versions = m_versions.keys();
-
-        for (const QString &version : versions)
+        QSqlQuery upsertVersion(db);
+        upsertVersion.prepare("INSERT INTO versions(name, ord) VALUES(?, ?) "
+                              "ON CONFLICT(name) DO UPDATE SET ord = excluded.ord");
+        for (int id = 0; id < m_versionOrder.size(); ++id)
         {
-            if (!m_versions.contains(version))
-                continue;
-            insertVersion.addBindValue(version);
-            insertVersion.addBindValue(order++);
-            if (!insertVersion.exec())
+            if (!ok)
+                break;
+            upsertVersion.addBindValue(m_versionOrder[id]);
+            upsertVersion.addBindValue(id);
+            if (!upsertVersion.exec())
             {
-                if (error)
-                    *error = insertVersion.lastError().text();
-                db.close();
-                QSqlDatabase::removeDatabase(connName);
-                return false;
+                fail(upsertVersion);
+                ok = false;
             }
         }
 
-        QSqlQuery insertItem(db);
-        insertItem.prepare("INSERT INTO items(version, key, section, name_zh, description_zh) VALUES(?, ?, ?, ?, ?)");
-        for (const QString &version : versions)
+        // Texts are stored once and referenced by id; empty texts are NULL.
+        // An incremental save finds each text through the hash index and
+        // tracks how its items change the reference counts.
+        QHash<QString, qint64> textIds;
+        QHash<qint64, int> refDeltas;
+        QSqlQuery selectText(db);
+        selectText.setForwardOnly(true);
+        selectText.prepare("SELECT id FROM texts WHERE hash = ? AND text = ?");
+        QSqlQuery insertText(db);
+        insertText.prepare("INSERT INTO texts(hash, text) VALUES(?, ?)");
+        auto textId = [&](const QString &text, QVariant *id) {
+            if (text.isEmpty())
+            {
+                *id = QVariant(QVariant::LongLong);
+                return true;
+            }
+            auto it = textIds.constFind(text);
+            if (it == textIds.constEnd())
+            {
+                const qint64 hash = textHash(text);
+                if (incremental)
+                {
+                    selectText.addBindValue(hash);
+                    selectText.addBindValue(text);
+                    if (!selectText.exec())
+                    {
+                        fail(selectText);
+                        return false;
+                    }
+                    if (selectText.next())
+                        it = textIds.insert(text, selectText.value(0).toLongLong());
+                    selectText.finish();
+                }
+                if (it == textIds.constEnd())
+                {
+                    insertText.addBindValue(hash);
+                    insertText.addBindValue(text);
+                    if (!insertText.exec())
+                    {
+                        fail(insertText);
+                        return false;
+                    }
+                    it = textIds.insert(text, insertText.lastInsertId().toLongLong());
+                }
+            }
+            *id = it.value();
+            ++refDeltas[it.value()];
+            return true;
+        };
+
+        // The texts an item used before it is rewritten lose a reference
+        QSqlQuery selectItem(db);
+        selectItem.setForwardOnly(true);
+        selectItem.prepare("SELECT section_id, name_id, description_id FROM items WHERE version = ? AND key = ?");
+        auto releaseTexts = [&](const QString &version, const QString &key) {
+            selectItem.addBindValue(version);
+            selectItem.addBindValue(key);
+            if (!selectItem.exec())
+            {
+                fail(selectItem);
+                return false;
+            }
+            if (selectItem.next())
+            {
+                for (int column = 0; column < 3; ++column)
+                {
+                    if (!selectItem.isNull(column))
+                        --refDeltas[selectItem.value(column).toLongLong()];
+                }
+            }
+            selectItem.finish();
+            return true;
+        };
+
+        QSqlQuery deleteSearchRow(db);
+        QSqlQuery insertSearch(db);
+        if (searchIndex)
         {
-            if (!m_versions.contains(version))
-                continue;
-            for (const TranslationItem &item : m_versions[version])
+            deleteSearchRow.prepare("DELETE FROM items_fts WHERE version = ? AND key = ?");
+            insertSearch.prepare(kInsertSearchRowSql);
+        }
+
+        QSqlQuery upsertItem(db);
+        upsertItem.prepare("INSERT INTO items(version, key, section_id, name_id, description_id) VALUES(?, ?, ?, ?, ?) "
+                           "ON CONFLICT(version, key) DO UPDATE SET section_id = excluded.section_id, "
+                           "name_id = excluded.name_id, description_id = excluded.description_id");
+        auto writeItem = [&](const QString &version, const TranslationItem &item) {
+            QVariant sectionId;
+            QVariant nameId;
+            QVariant descriptionId;
+            if (incremental && !releaseTexts(version, item.key))
+                return false;
+            if (!textId(item.section, &sectionId) || !textId(item.nameZh, &nameId) ||
+                !textId(item.descriptionZh, &descriptionId))
             {
-                if (item.key.isEmpty())
-                    continue;
-                insertItem.addBindValue(version);
-                insertItem.addBindValue(item.key);
-                insertItem.addBindValue(item.section);
-                insertItem.addBindValue(item.nameZh);
-                insertItem.addBindValue(item.descriptionZh);
-                if (!insertItem.exec())
+                return false;
+            }
+            upsertItem.addBindValue(version);
+            upsertItem.addBindValue(item.key);
+            upsertItem.addBindValue(sectionId);
+            upsertItem.addBindValue(nameId);
+            upsertItem.addBindValue(descriptionId);
+            if (!upsertItem.exec())
+            {
+                fail(upsertItem);
+                return false;
+            }
+            if (!searchIndex)
+                return true;
+
+            // items_fts has no key index; replacing a row scans it, which is
+            // fine for the few items an incremental save writes
+            if (incremental)
+            {
+                deleteSearchRow.addBindValue(version);
+                deleteSearchRow.addBindValue(item.key);
+                if (!deleteSearchRow.exec())
                 {
-                    if (error)
-                        *error = insertItem.lastError().text();
-                    db.close();
-                    QSqlDatabase::removeDatabase(connName);
+                    fail(deleteSearchRow);
                     return false;
                 }
             }
+            if (insertSearchRow(insertSearch, version, item.key, item.nameZh, item.descriptionZh))
+                return true;
+            fail(insertSearch);
+            return false;
+        };
+
+        int written = 0;
+        for (int id = 0; id < m_versionOrder.size(); ++id)
+        {
+            if (!ok)
+                break;
+            const QString &version = m_versionOrder[id];
+            if (incremental)
+            {
+                for (const QString &key : m_dirtyKeys.value(version))
+                {
+                    const TranslationItem *item = m_items.find(id, key);
+                    if (item && !(ok = writeItem(version, *item)))
+                        break;
+                }
+            }
+            else
+            {
+                for (const TranslationItem *item : m_items.items(id))
+                {
+                    if (!(ok = writeItem(version, *item)))
+                        break;
+                    if (progress && ++written % kSaveBatchSize == 0)
+                    {
+                        if (!(ok = db.commit() && db.transaction()))
+                        {
+                            if (error)
+                                *error = db.lastError().text();
+                            break;
+                        }
+                        progress(written, m_items.size());
+                    }
+                }
+            }
+        }
+
+        // Only texts that lost a reference can have become unused
+        QSqlQuery updateRefs(db);
+        updateRefs.prepare("UPDATE texts SET refs = refs + ? WHERE id = ?");
+        QSqlQuery prune(db);
+        prune.prepare("DELETE FROM texts WHERE id = ? AND refs <= 0");
+        for (auto it = refDeltas.constBegin(); ok && it != refDeltas.constEnd(); ++it)
+        {
+            if (it.value() == 0)
+                continue;
+            updateRefs.addBindValue(it.value());
+            updateRefs.addBindValue(it.key());
+            if (!updateRefs.exec())
+            {
+                fail(updateRefs);
+                ok = false;
+                break;
+            }
+            if (it.value() > 0)
+                continue;
+            prune.addBindValue(it.key());
+            if (!prune.exec())
+            {
+                fail(prune);
+                ok = false;
+            }
+        }
+
+        if (ok && !db.commit())
+        {
+            if (error)
+                *error = db.lastError().text();
+            db.rollback();
+            ok = false;
         }
 
         db.close();
     }
     QSqlDatabase::removeDatabase(connName);
-    return true;
+
+    if (ok)
+    {
+        m_dirtyKeys.clear();
+        m_syncedPath = absolutePath;
+        if (progress)
+            progress(m_items.size(), m_items.size());
+    }
+    return ok;
 }
 
+// The whole file is decoded once and walked front to back. A version header
+// ("  'version':") only counts when the next meaningful line is "    items:",
+// so it is held back until that line has been seen instead of reading ahead.
 bool TranslationStore::loadFromYaml(const QString &path, QString *error)
 {
-    m_versions.clear();
-    m_versionOrder.clear();
-    m_currentVersion.clear();
-
     QFile file(path);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!file.open(QIODevice::ReadOnly))
     {
         if (error)
             *error = QString("Failed to open translation: %1").arg(path);
         return false;
     }
+    parseYaml(file.readAll());
+    return true;
+}
+
+void TranslationStore::parseYaml(const QByteArray &data)
+{
+    reset();
+
+    const int bom = data.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+    const QString text = QString::fromUtf8(data.constData() + bom, data.size() - bom);
 
-    QTextStream in(&file);
-    in.setCodec("UTF-8");
     TranslationItem current;
     bool inItem = false;
     bool inMultilineDesc = false;
@@ -278,93 +1028,39 @@ bool TranslationStore::loadFromYaml(const QString &path, QString *error)
     bool inItems = false;
     bool inLegacyList = false;
     QString currentVersion;
+    int currentId = -1;
+    QStringRef pendingHeader;
+    bool hasPendingHeader = false;
 
-    while (!in.atEnd())
-    {
-        QString line = in.readLine();
-        QString trimmed = line.trimmed();
-        int leadingSpaces = 0;
-        while (leadingSpaces < line.size() && line[leadingSpaces] == ' ')
-            leadingSpaces++;
-
-        // Handle multiline description continuation
-        if (inMultilineDesc)
-        {
-            // Check if this line is still part of the multiline block
-            int indent = leadingSpaces;
-
-            // If line is empty or has sufficient indentation, it's part of the block
-            if (trimmed.isEmpty() || indent >= multilineIndent)
-            {
-                multilineLines.append(trimmed);
-                continue;
-            }
-            else
-            {
-                // End of multiline block
-                current.descriptionZh = multilineLines.join("\n");
-                inMultilineDesc = false;
-                multilineLines.clear();
-            }
-        }
-
-        if (trimmed.isEmpty() || trimmed.startsWith('#'))
-            continue;
-
-        if (trimmed == "versions:")
+    auto processLine = [&](const QStringRef &trimmed, int leadingSpaces, bool allowHeader) {
+        if (trimmed == QLatin1String("versions:"))
         {
             inVersions = true;
             inItems = false;
             inLegacyList = false;
-            continue;
+            return;
         }
 
         if (inVersions)
         {
             // Version keys are only valid at indent level 2: "  'version':"
-            if (leadingSpaces == 2 && trimmed.endsWith(':') && trimmed != "items:")
+            if (allowHeader && leadingSpaces == 2 && trimmed.endsWith(':') && trimmed != QLatin1String("items:"))
             {
-                if (inItem && !current.key.isEmpty() && !currentVersion.isEmpty())
+                if (inItem && !current.key.isEmpty() && currentId >= 0)
                 {
-                    m_versions[currentVersion].insert(current.key, current);
+                    m_items.insert(currentId, current);
                     current = TranslationItem();
                     inItem = false;
                 }
-                // Validate that the next meaningful line is "items:" at indent 4
-                qint64 lastPos = in.pos();
-                QString nextLine;
-                while (!in.atEnd())
-                {
-                    nextLine = in.readLine();
-                    QString nextTrimmed = nextLine.trimmed();
-                    if (nextTrimmed.isEmpty() || nextTrimmed.startsWith('#'))
-                        continue;
-                    int nextLeading = 0;
-                    while (nextLeading < nextLine.size() && nextLine[nextLeading] == ' ')
-                        nextLeading++;
-                    bool validItems = (nextLeading == 4 && nextTrimmed == "items:");
-                    in.seek(lastPos);
-                    if (!validItems)
-                        nextLine.clear();
-                    break;
-                }
-                if (!nextLine.isEmpty())
-                {
-                    currentVersion = stripQuotes(trimmed.left(trimmed.size() - 1).trimmed());
-                    if (!currentVersion.isEmpty() && !m_versions.contains(currentVersion))
-                    {
-                        m_versions.insert(currentVersion, QHash<QString, TranslationItem>());
-                        m_versionOrder.append(currentVersion);
-                    }
-                    inItems = false;
-                    continue;
-                }
+                pendingHeader = trimmed;
+                hasPendingHeader = true;
+                return;
             }
             // "items:" is only valid under a version at indent level 4
-            if (leadingSpaces == 4 && trimmed == "items:")
+            if (leadingSpaces == 4 && trimmed == QLatin1String("items:"))
             {
                 inItems = true;
-                continue;
+                return;
             }
         }
 
@@ -375,54 +1071,53 @@ bool TranslationStore::loadFromYaml(const QString &path, QString *error)
                 if (!inLegacyList)
                 {
                     currentVersion = "default";
-                    m_versions.insert(currentVersion, QHash<QString, TranslationItem>());
-                    m_versionOrder.append(currentVersion);
+                    currentId = addVersion(currentVersion);
                     inLegacyList = true;
                 }
                 inItems = true;
             }
             else if (!inItems)
             {
-                continue;
+                return;
             }
 
-            if (inItem && !current.key.isEmpty())
-                m_versions[currentVersion].insert(current.key, current);
+            if (inItem && !current.key.isEmpty() && currentId >= 0)
+                m_items.insert(currentId, current);
 
             current = TranslationItem();
             inItem = true;
 
-            QString rest = trimmed.mid(1).trimmed();
+            QStringRef rest = trimmed.mid(1).trimmed();
             if (!rest.isEmpty())
             {
-                QString key;
-                QString value;
+                QStringRef key;
+                QStringRef value;
                 if (parseKeyValue(rest, &key, &value))
                 {
-                    if (key == "key")
-                        current.key = value;
+                    if (key == QLatin1String("key"))
+                        current.key = value.toString();
                 }
             }
-            continue;
+            return;
         }
 
         if (!inItem)
-            continue;
+            return;
 
-        QString key;
-        QString value;
+        QStringRef key;
+        QStringRef value;
         if (!parseKeyValue(trimmed, &key, &value))
-            continue;
+            return;
 
-        if (key == "key")
-            current.key = value;
-        else if (key == "section")
-            current.section = value;
-        else if (key == "name_zh")
-            current.nameZh = value;
-        else if (key == "description_zh")
+        if (key == QLatin1String("key"))
+            current.key = value.toString();
+        else if (key == QLatin1String("section"))
+            current.section = value.toString();
+        else if (key == QLatin1String("name_zh"))
+            current.nameZh = value.toString();
+        else if (key == QLatin1String("description_zh"))
         {
-            if (value == "|" || value == ">")
+            if (value == QLatin1String("|") || value == QLatin1String(">"))
             {
                 // Start multiline block
                 inMultilineDesc = true;
@@ -431,28 +1126,82 @@ bool TranslationStore::loadFromYaml(const QString &path, QString *error)
             }
             else
             {
-                current.descriptionZh = value;
+                current.descriptionZh = value.toString();
+            }
+        }
+    };
+
+    int pos = 0;
+    while (pos < text.size())
+    {
+        const QStringRef line = nextLine(text, &pos);
+        const QStringRef trimmed = line.trimmed();
+        int leadingSpaces = 0;
+        while (leadingSpaces < line.size() && line.at(leadingSpaces) == ' ')
+            leadingSpaces++;
+
+        // Handle multiline description continuation
+        if (inMultilineDesc)
+        {
+            // If line is empty or has sufficient indentation, it's part of the block
+            if (trimmed.isEmpty() || leadingSpaces >= multilineIndent)
+            {
+                multilineLines.append(trimmed.toString());
+                continue;
+            }
+
+            // End of multiline block
+            current.descriptionZh = multilineLines.join("\n");
+            inMultilineDesc = false;
+            multilineLines.clear();
+        }
+
+        if (trimmed.isEmpty() || trimmed.startsWith('#'))
+            continue;
+
+        if (hasPendingHeader)
+        {
+            hasPendingHeader = false;
+            if (leadingSpaces == 4 && trimmed == QLatin1String("items:"))
+            {
+                currentVersion = stripQuotes(pendingHeader.left(pendingHeader.size() - 1).trimmed()).toString();
+                currentId = currentVersion.isEmpty() ? -1 : addVersion(currentVersion);
+                inItems = false;
+            }
+            else
+            {
+                // Not a version after all; handle it as an ordinary line
+                processLine(pendingHeader, 2, false);
             }
         }
+
+        processLine(trimmed, leadingSpaces, true);
     }
 
+    if (hasPendingHeader)
+        processLine(pendingHeader, 2, false);
+
     // Handle end of file with multiline description
     if (inMultilineDesc && !multilineLines.isEmpty())
     {
         current.descriptionZh = multilineLines.join("\n");
     }
 
-    if (inItem && !current.key.isEmpty())
-        m_versions[currentVersion].insert(current.key, current);
+    if (inItem && !current.key.isEmpty() && currentId >= 0)
+        m_items.insert(currentId, current);
 
     if (!m_versionOrder.isEmpty())
+    {
         m_currentVersion = m_versionOrder.first();
-
-    return true;
+        m_currentId = 0;
+    }
 }
 
-bool TranslationStore::saveToYaml(const QString &path, QString *error) const
+bool TranslationStore::saveToYaml(const QString &path, QString *error)
 {
+    if (!fetchAllVersions(error))
+        return false;
+
     QFile file(path);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
     {
@@ -466,27 +1215,19 @@ bool TranslationStore::saveToYaml(const QString &path, QString *error) const
 
     out << "versions:\n";
 
-    QStringList versions = m_versionOrder;
-    if (versions.isEmpty())
-        versions = m_versions.keys();
-
-    for (const QString &version : versions)
+    for (int id = 0; id < m_versionOrder.size(); ++id)
     {
-        if (!m_versions.contains(version))
-            continue;
-        out << "  " << formatYamlValue(version) << ":\n";
+        out << "  " << formatYamlValue(m_versionOrder[id]) << ":\n";
         out << "    items:\n";
 
-        QVector<TranslationItem> items;
-        items.reserve(m_versions[version].size());
-        for (const TranslationItem &item : m_versions[version])
-            items.push_back(item);
-        std::sort(items.begin(), items.end(), [](const TranslationItem &a, const TranslationItem &b) {
-            return a.key < b.key;
+        QVector<const TranslationItem *> items = m_items.items(id);
+        std::sort(items.begin(), items.end(), [](const TranslationItem *a, const TranslationItem *b) {
+            return a->key < b->key;
         });
 
-        for (const TranslationItem &item : items)
+        for (const TranslationItem *entry : items)
         {
+            const TranslationItem &item = *entry;
             out << "    - key: " << formatYamlValue(item.key) << "\n";
             if (!item.section.isEmpty())
                 out << "      section: " << formatYamlValue(item.section) << "\n";
@@ -514,25 +1255,37 @@ bool TranslationStore::saveToYaml(const QString &path, QString *error) const
     return true;
 }
 
-bool TranslationStore::load(const QString &path, QString *error)
+bool TranslationStore::load(const QString &path, QString *error, const QString &preferredVersion, OpenMode mode)
 {
+    m_readOnly = mode == ReadOnly;
     if (isSqlitePath(path))
-        return loadFromSqlite(path, error);
-    return loadFromYaml(path, error);
+        return loadFromSqlite(path, error, preferredVersion);
+    if (isPackPath(path))
+        return loadFromPack(path, error, preferredVersion);
+    if (!loadFromYaml(path, error))
+        return false;
+    setCurrentVersion(preferredVersion);
+    return true;
 }
 
-bool TranslationStore::save(const QString &path, QString *error) const
+bool TranslationStore::save(const QString &path, QString *error)
 {
+    if (m_readOnly)
+    {
+        if (error)
+            *error = QString("Translations were opened read-only");
+        return false;
+    }
     if (isSqlitePath(path))
         return saveToSqlite(path, error);
+    if (isPackPath(path))
+        return saveToPack(path, error);
     return saveToYaml(path, error);
 }
 
 QStringList TranslationStore::availableVersions() const
 {
-    if (!m_versionOrder.isEmpty())
-        return m_versionOrder;
-    return m_versions.keys();
+    return m_versionOrder;
 }
 
 QString TranslationStore::currentVersion() const
@@ -540,24 +1293,45 @@ QString TranslationStore::currentVersion() const
     return m_currentVersion;
 }
 
-bool TranslationStore::setCurrentVersion(const QString &version)
+bool TranslationStore::setCurrentVersion(const QString &version, QString *error)
 {
-    if (!m_versions.contains(version))
+    const int id = m_versionOrder.indexOf(version);
+    if (id < 0)
+    {
+        if (error)
+            *error = QString("Unknown translation version: %1").arg(version);
+        return false;
+    }
+    if (!fetchVersion(version, error))
         return false;
     m_currentVersion = version;
+    m_currentId = id;
     return true;
 }
 
+const TranslationItem *TranslationStore::find(const QString &key) const
+{
+    if (!m_packVersions.contains(m_currentVersion))
+        return m_items.find(m_currentId, key);
+
+    // Only the item asked for is built from the mapped pack
+    const int version = m_pack->versionIndex(m_currentVersion);
+    const int index = m_pack->find(version, key);
+    if (index < 0)
+        return nullptr;
+    m_packLookup = m_pack->itemAt(version, index);
+    return &m_packLookup;
+}
+
 bool TranslationStore::contains(const QString &key) const
 {
-    return m_versions.contains(m_currentVersion) && m_versions[m_currentVersion].contains(key);
+    return find(key) != nullptr;
 }
 
 TranslationItem TranslationStore::item(const QString &key) const
 {
-    if (!m_versions.contains(m_currentVersion))
-        return TranslationItem();
-    return m_versions[m_currentVersion].value(key);
+    const TranslationItem *item = find(key);
+    return item ? *item : TranslationItem();
 }
 
 void TranslationStore::upsert(const TranslationItem &item)
@@ -567,26 +1341,206 @@ void TranslationStore::upsert(const TranslationItem &item)
     if (m_currentVersion.isEmpty())
     {
         m_currentVersion = "default";
-        if (!m_versions.contains(m_currentVersion))
-            m_versions.insert(m_currentVersion, QHash<QString, TranslationItem>());
-        if (!m_versionOrder.contains(m_currentVersion))
-            m_versionOrder.append(m_currentVersion);
+        m_currentId = addVersion(m_currentVersion);
     }
-    m_versions[m_currentVersion].insert(item.key, item);
+    unpackVersion(m_currentVersion);
+    m_items.insert(m_currentId, item);
+    m_dirtyKeys[m_currentVersion].insert(item.key);
 }
 
 QVector<TranslationItem> TranslationStore::allItems() const
 {
-    QVector<TranslationItem> items;
-    if (!m_versions.contains(m_currentVersion))
+    if (m_packVersions.contains(m_currentVersion))
+    {
+        // Pack items are already sorted by key
+        const int version = m_pack->versionIndex(m_currentVersion);
+        const int count = m_pack->itemCount(version);
+        QVector<TranslationItem> items;
+        items.reserve(count);
+        for (int i = 0; i < count; ++i)
+            items.push_back(m_pack->itemAt(version, i));
         return items;
+    }
 
-    items.reserve(m_versions[m_currentVersion].size());
-    for (const TranslationItem &item : m_versions[m_currentVersion])
-        items.push_back(item);
-
-    std::sort(items.begin(), items.end(), [](const TranslationItem &a, const TranslationItem &b) {
-        return a.key < b.key;
+    QVector<const TranslationItem *> sorted = m_items.items(m_currentId);
+    std::sort(sorted.begin(), sorted.end(), [](const TranslationItem *a, const TranslationItem *b) {
+        return a->key < b->key;
     });
+
+    QVector<TranslationItem> items;
+    items.reserve(sorted.size());
+    for (const TranslationItem *item : sorted)
+        items.push_back(*item);
     return items;
 }
+
+// Keys weigh most, then names; the version column is not searched
+QVector<TranslationSearchHit> TranslationStore::search(const QString &query, const QString &version,
+                                                      int limit, QString *error) const
+{
+    QVector<TranslationSearchHit> hits;
+    if (m_syncedPath.isEmpty())
+    {
+        if (error)
+            *error = QString("Full-text search needs a translation database");
+        return hits;
+    }
+
+    const QString match = searchQuery(query);
+    if (match.isEmpty())
+        return hits;
+
+    const QString connName = QString("translation_search_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
+        db.setDatabaseName(m_syncedPath);
+        // Searching never writes, whatever mode the store was loaded in
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (!db.open())
+        {
+            if (error)
+                *error = db.lastError().text();
+        }
+        else if (!hasSearchIndex(db))
+        {
+            if (error)
+                *error = QString("Full-text search is not available: %1").arg(m_syncedPath);
+            db.close();
+        }
+        else
+        {
+            QSqlQuery q(db);
+            q.setForwardOnly(true);
+            q.prepare("SELECT f.version, f.key, n.text FROM items_fts f "
+                      "LEFT JOIN items i ON i.version = f.version AND i.key = f.key "
+                      "LEFT JOIN texts n ON n.id = i.name_id "
+                      "WHERE items_fts MATCH ? AND (? = '' OR f.version = ?) "
+                      "ORDER BY bm25(items_fts, 0.0, 0.0, 10.0, 5.0, 1.0) LIMIT ?");
+            // A null QString would bind as NULL
+            const QString versionFilter = version.isEmpty() ? QString("") : version;
+            q.addBindValue(match);
+            q.addBindValue(versionFilter);
+            q.addBindValue(versionFilter);
+            q.addBindValue(limit);
+            if (q.exec())
+            {
+                while (q.next())
+                {
+                    TranslationSearchHit hit;
+                    hit.version = q.value(0).toString();
+                    hit.key = q.value(1).toString();
+                    hit.nameZh = q.value(2).toString();
+                    hits.push_back(hit);
+                }
+            }
+            else if (error)
+            {
+                *error = q.lastError().text();
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connName);
+    return hits;
+}
+
+QByteArray TranslationStore::sourceHash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+QByteArray TranslationStore::migratedSourceHash(const QString &dbPath)
+{
+    QByteArray hash;
+    if (!QFileInfo::exists(dbPath))
+        return hash;
+
+    const QString connName = QString("translation_meta_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
+        db.setDatabaseName(dbPath);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (db.open())
+        {
+            // Older databases have no meta table; the query then just fails
+            QSqlQuery q(db);
+            if (q.exec("SELECT value FROM meta WHERE name = 'source_sha256'") && q.next())
+                hash = q.value(0).toByteArray();
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connName);
+    return hash;
+}
+
+// The database is built next to dbPath and renamed over it at the end, so an
+// interrupted migration never leaves a half written dbPath behind. Batches are
+// committed separately, which is only safe because nobody reads that file yet.
+bool TranslationStore::migrateYamlToSqlite(const QString &yamlPath, const QString &dbPath,
+                                           const SaveProgress &progress, QString *error)
+{
+    QFile file(yamlPath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        if (error)
+            *error = QString("Failed to open translation: %1").arg(yamlPath);
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    const QByteArray hash = sourceHash(data);
+    if (migratedSourceHash(dbPath) == hash)
+        return true;
+
+    TranslationStore store;
+    store.parseYaml(data);
+
+    const QString partPath = dbPath + ".part";
+    auto removeDatabaseFiles = [](const QString &path) {
+        QFile::remove(path + "-wal");
+        QFile::remove(path + "-shm");
+        return !QFile::exists(path) || QFile::remove(path);
+    };
+    removeDatabaseFiles(partPath);
+
+    if (!store.saveToSqlite(partPath, error, progress))
+    {
+        removeDatabaseFiles(partPath);
+        return false;
+    }
+
+    // Closing the last connection checkpoints the WAL into the file itself
+    const QString connName = QString("translation_meta_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connName);
+        db.setDatabaseName(partPath);
+        if (db.open())
+        {
+            QSqlQuery q(db);
+            q.prepare("INSERT INTO meta(name, value) VALUES('source_sha256', ?) "
+                      "ON CONFLICT(name) DO UPDATE SET value = excluded.value");
+            q.addBindValue(hash);
+            ok = q.exec();
+            if (!ok && error)
+                *error = q.lastError().text();
+            db.close();
+        }
+        else if (error)
+        {
+            *error = db.lastError().text();
+        }
+    }
+    QSqlDatabase::removeDatabase(connName);
+
+    if (ok && !(removeDatabaseFiles(dbPath) && QFile::rename(partPath, dbPath)))
+    {
+        if (error)
+            *error = QString("Failed to write translation: %1").arg(dbPath);
+        ok = false;
+    }
+    if (!ok)
+        removeDatabaseFiles(partPath);
+    return ok;
+}
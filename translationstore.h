@@ -3,37 +3,117 @@
 #include <QString>
 #include <QVector>
 #include <QHash>
+#include <QSet>
+#include <QSharedPointer>
 
-struct TranslationItem
+#include <functional>
+
+#include "translationtable.h"
+
+class TranslationPack;
+
+struct TranslationSearchHit
 {
+    QString version;
     QString key;
-    QString section;
     QString nameZh;
-    QString descriptionZh;
 };
 
+// Move-only: a store can hold thousands of items, so it is handed between
+// threads by moving it rather than by copying.
 class TranslationStore
 {
 public:
-    bool load(const QString &path, QString *error);
-    bool save(const QString &path, QString *error) const;
+    // Items written so far and in total
+    using SaveProgress = std::function<void(int written, int total)>;
+
+    enum OpenMode
+    {
+        ReadWrite,   // A SQLite file is created or migrated to the current schema
+        ReadOnly     // A SQLite file is left as it is; a missing file or one that
+                     // still needs migrating fails to load, and save() fails
+    };
+
+    TranslationStore() = default;
+    TranslationStore(TranslationStore &&other) = default;
+    TranslationStore &operator=(TranslationStore &&other) = default;
+
+    // The format follows the extension: .db/.sqlite/.sqlite3, .wypack (binary
+    // pack, queried in place) or YAML.
+    // A SQLite store only reads the items of the initial version (preferredVersion
+    // when it exists, otherwise the first one); the others are read when
+    // setCurrentVersion() first switches to them
+    bool load(const QString &path, QString *error, const QString &preferredVersion = QString(),
+              OpenMode mode = ReadWrite);
+    // Saving back to the SQLite file the store was loaded from (or last saved
+    // to) only writes the items changed since then
+    bool save(const QString &path, QString *error);
+    // Takes path, a SQLite file written from the same content as this store
+    // (e.g. migrated from the YAML it was loaded from), as the file later
+    // saves update and search() reads. Ignored once the store is synced.
+    void adoptSqlite(const QString &path);
 
     QStringList availableVersions() const;
     QString currentVersion() const;
-    bool setCurrentVersion(const QString &version);
+    // Fails for an unknown version or when its items cannot be read from the
+    // SQLite file; the current version is kept then
+    bool setCurrentVersion(const QString &version, QString *error = nullptr);
 
+    // Lookups in the current version. The pointer stays valid until the next
+    // lookup, until the store is modified or switches versions.
+    const TranslationItem *find(const QString &key) const;
     bool contains(const QString &key) const;
     TranslationItem item(const QString &key) const;
     void upsert(const TranslationItem &item);
     QVector<TranslationItem> allItems() const;
 
+    // Ranked full-text search over key, name_zh and description_zh in the
+    // SQLite file the store was loaded from or last saved to, so unsaved edits
+    // are not seen. An empty version searches all of them.
+    QVector<TranslationSearchHit> search(const QString &query, const QString &version,
+                                         int limit, QString *error) const;
+
+    // Sharing of identical texts among the items read so far
+    TranslationTextStats textStats() const { return m_items.textStats(); }
+
+    // Builds the SQLite file dbPath from the YAML file yamlPath, committing in
+    // batches and reporting progress. Returns at once when dbPath was already
+    // migrated from the same YAML content.
+    static bool migrateYamlToSqlite(const QString &yamlPath, const QString &dbPath,
+                                    const SaveProgress &progress, QString *error);
+    // SHA-256 of the YAML content dbPath was migrated from; empty when unknown
+    // or when the file was saved from the editor since
+    static QByteArray migratedSourceHash(const QString &dbPath);
+    static QByteArray sourceHash(const QByteArray &data);
+
 private:
+    Q_DISABLE_COPY(TranslationStore)
+
+    void reset();
+    int addVersion(const QString &version);
     bool loadFromYaml(const QString &path, QString *error);
-    bool loadFromSqlite(const QString &path, QString *error);
-    bool saveToYaml(const QString &path, QString *error) const;
-    bool saveToSqlite(const QString &path, QString *error) const;
+    void parseYaml(const QByteArray &data);
+    bool loadFromSqlite(const QString &path, QString *error, const QString &preferredVersion);
+    bool fetchVersion(const QString &version, QString *error);
+    bool fetchAllVersions(QString *error);
+    bool loadFromPack(const QString &path, QString *error, const QString &preferredVersion);
+    void unpackVersion(const QString &version);
+    bool saveToPack(const QString &path, QString *error);
+    bool saveToYaml(const QString &path, QString *error);
+    // With progress set, a full rewrite commits every few hundred items
+    bool saveToSqlite(const QString &path, QString *error, const SaveProgress &progress = SaveProgress());
 
-    QHash<QString, QHash<QString, TranslationItem>> m_versions;
-    QStringList m_versionOrder;
+    TranslationTable m_items;
+    QStringList m_versionOrder;                   // Index is the version id in m_items
     QString m_currentVersion;
+    int m_currentId = -1;
+
+    QHash<QString, QSet<QString>> m_dirtyKeys;   // Version -> keys upserted since the last sync
+    QString m_syncedPath;                         // SQLite file that holds everything but m_dirtyKeys
+    QSet<QString> m_unfetchedVersions;            // Listed in m_syncedPath but not read yet
+
+    QSharedPointer<const TranslationPack> m_pack;
+    QSet<QString> m_packVersions;                 // Still only in m_pack; unpacked when first edited
+    mutable TranslationItem m_packLookup;         // Last item find() built from m_pack
+    bool m_readOnly = false;                      // Loaded with ReadOnly
 };
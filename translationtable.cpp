@@ -0,0 +1,148 @@
+#include "translationtable.h"
+
+#include <QHash>
+
+static const int kMinSlots = 64;
+
+void TranslationTable::clear()
+{
+    m_entries.clear();
+    m_slots.clear();
+    m_counts.clear();
+    m_texts.clear();
+}
+
+void TranslationTable::reserve(int count)
+{
+    m_entries.reserve(count);
+    int slots = kMinSlots;
+    while (slots < count * 2)
+        slots *= 2;
+    if (slots > m_slots.size())
+        rehash(slots);
+}
+
+uint TranslationTable::hashOf(int version, const QString &key)
+{
+    return qHash(key, static_cast<uint>(version) * 0x9E3779B9u);
+}
+
+// Linear probing; the table is kept at most half full, so probe runs are short
+int TranslationTable::findSlot(int version, const QString &key, uint hash) const
+{
+    const int mask = m_slots.size() - 1;
+    for (int slot = static_cast<int>(hash & mask);; slot = (slot + 1) & mask)
+    {
+        const int entry = m_slots[slot];
+        if (entry == 0)
+            return slot;
+        const Entry &e = m_entries[entry - 1];
+        if (e.hash == hash && e.version == version && e.item.key == key)
+            return slot;
+    }
+}
+
+QString TranslationTable::intern(const QString &text)
+{
+    if (text.isEmpty())
+        return QString();
+    auto it = m_texts.constFind(text);
+    if (it != m_texts.constEnd())
+        return *it;
+    m_texts.insert(text);
+    return text;
+}
+
+void TranslationTable::rehash(int slotCount)
+{
+    m_slots.fill(0, slotCount);
+    const int mask = slotCount - 1;
+    for (int i = 0; i < m_entries.size(); ++i)
+    {
+        int slot = static_cast<int>(m_entries[i].hash & mask);
+        while (m_slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        m_slots[slot] = i + 1;
+    }
+}
+
+void TranslationTable::insert(int version, const TranslationItem &item)
+{
+    if ((m_entries.size() + 1) * 2 > m_slots.size())
+        rehash(qMax(kMinSlots, m_slots.size() * 2));
+
+    TranslationItem shared;
+    shared.key = intern(item.key);
+    shared.section = intern(item.section);
+    shared.nameZh = intern(item.nameZh);
+    shared.descriptionZh = intern(item.descriptionZh);
+
+    const uint hash = hashOf(version, shared.key);
+    const int slot = findSlot(version, shared.key, hash);
+    if (m_slots[slot] != 0)
+    {
+        m_entries[m_slots[slot] - 1].item = shared;
+        return;
+    }
+
+    Entry entry;
+    entry.item = shared;
+    entry.version = version;
+    entry.hash = hash;
+    m_entries.push_back(entry);
+    m_slots[slot] = m_entries.size();
+
+    if (version >= m_counts.size())
+        m_counts.resize(version + 1);
+    ++m_counts[version];
+}
+
+const TranslationItem *TranslationTable::find(int version, const QString &key) const
+{
+    if (m_slots.isEmpty())
+        return nullptr;
+    const int entry = m_slots[findSlot(version, key, hashOf(version, key))];
+    return entry != 0 ? &m_entries[entry - 1].item : nullptr;
+}
+
+QVector<const TranslationItem *> TranslationTable::items(int version) const
+{
+    QVector<const TranslationItem *> result;
+    result.reserve(count(version));
+    for (const Entry &entry : m_entries)
+    {
+        if (entry.version == version)
+            result.push_back(&entry.item);
+    }
+    return result;
+}
+
+// Counted from the items rather than the intern set, which still holds texts
+// that edits have replaced
+TranslationTextStats TranslationTable::textStats() const
+{
+    TranslationTextStats stats;
+    QSet<const QChar *> stored;
+    auto count = [&](const QString &text) {
+        if (text.isEmpty())
+            return;
+        const qint64 bytes = qint64(text.size()) * sizeof(QChar);
+        ++stats.references;
+        stats.referencedBytes += bytes;
+        if (!stored.contains(text.constData()))
+        {
+            stored.insert(text.constData());
+            stats.storedBytes += bytes;
+        }
+    };
+
+    for (const Entry &entry : m_entries)
+    {
+        count(entry.item.key);
+        count(entry.item.section);
+        count(entry.item.nameZh);
+        count(entry.item.descriptionZh);
+    }
+    stats.uniqueTexts = stored.size();
+    return stats;
+}
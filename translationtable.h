@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+struct TranslationItem
+{
+    QString key;
+    QString section;
+    QString nameZh;
+    QString descriptionZh;
+};
+
+// How much the interning in TranslationTable saves
+struct TranslationTextStats
+{
+    int references = 0;          // Non-empty strings held by items
+    int uniqueTexts = 0;         // Distinct strings actually allocated
+    qint64 referencedBytes = 0;  // UTF-16 size if every reference had its own copy
+    qint64 storedBytes = 0;
+};
+
+// Open-addressing hash table of translation items keyed by (version id, key).
+// Items live in one contiguous array in insertion order and the slot array
+// only holds their positions, so a lookup hashes the key once and touches a
+// slot and an item. Pointers returned by find() stay valid until the next
+// insert() or clear().
+// Identical strings are interned on insert, so a text repeated across keys or
+// versions is allocated once and the items only share it.
+class TranslationTable
+{
+public:
+    void clear();
+    void reserve(int count);
+
+    // Inserts item, or replaces the item with the same version and key
+    void insert(int version, const TranslationItem &item);
+    const TranslationItem *find(int version, const QString &key) const;
+
+    int size() const { return m_entries.size(); }
+    int count(int version) const { return version >= 0 && version < m_counts.size() ? m_counts[version] : 0; }
+    // Items of one version in insertion order
+    QVector<const TranslationItem *> items(int version) const;
+
+    TranslationTextStats textStats() const;
+
+private:
+    struct Entry
+    {
+        TranslationItem item;
+        int version = 0;
+        uint hash = 0;
+    };
+
+    static uint hashOf(int version, const QString &key);
+    QString intern(const QString &text);
+    int findSlot(int version, const QString &key, uint hash) const;
+    void rehash(int slotCount);
+
+    QVector<Entry> m_entries;
+    QVector<int> m_slots;    // Entry index + 1, 0 when empty; the size is a power of two
+    QVector<int> m_counts;   // Items per version
+    QSet<QString> m_texts;
+};